@@ -0,0 +1,89 @@
+#include "ijson2_binary.hh"
+#include "ijson2_parser.hh"
+#include "ijson2_formatter.hh"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+
+static rusage ru_start;
+
+static void start_timing() {
+	getrusage(RUSAGE_SELF,&ru_start);
+}
+
+static void stop_timing(const char *what) {
+	rusage ru_end;
+	getrusage(RUSAGE_SELF,&ru_end);
+	
+	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
+	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
+	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
+	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
+	printf("%s:\n", what);
+	printf("  utime: %.3f\n", utime);
+	printf("  stime: %.3f\n", stime);
+}
+
+
+int main() {
+	FILE *fp = fopen("performance_test_input.json", "r");
+	if(!fp) {
+		perror("performance_test_input.json");
+		return 1;
+	}
+	fseek(fp,0,SEEK_END);
+	long bytes = ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	
+	char *buf = new char[bytes];
+	fread(buf, 1, bytes, fp);
+	fclose(fp);
+	
+	ijson2::Parser parser;
+	parser.parse(buf, bytes);
+	
+	std::string s;
+	auto append = [](const char *src, size_t srcsize, void *append_context) {
+		static_cast<std::string*>(append_context)->append(src,srcsize);
+	};
+	
+	std::string json;
+	ijson2::format(parser.value(),append,&json);
+	std::string binary;
+	ijson2::encode_binary(parser.value(),append,&binary);
+	printf("JSON: %zu bytes, binary: %zu bytes\n", json.size(), binary.size());
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::format(parser.value(),append,&s);
+	}
+	stop_timing("format");
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::encode_binary(parser.value(),append,&s);
+	}
+	stop_timing("encode_binary");
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		ijson2::Parser p;
+		p.parse(json.data(), json.size());
+	}
+	stop_timing("parse JSON");
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		ijson2::BinaryParser p;
+		p.parse(binary.data(), binary.size());
+	}
+	stop_timing("parse binary");
+	
+	delete[] buf;
+	
+	return 0;
+}
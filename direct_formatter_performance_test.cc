@@ -1,19 +1,47 @@
 #include "ijson2_direct_formatter.hh"
+#include "ijson2_prepared_template.hh"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+
+static rusage ru_start;
+static timespec wall_start;
+
+static void start_timing() {
+	getrusage(RUSAGE_SELF,&ru_start);
+	clock_gettime(CLOCK_MONOTONIC,&wall_start);
+}
+
+static void stop_timing(const char *what) {
+	rusage ru_end;
+	getrusage(RUSAGE_SELF,&ru_end);
+	timespec wall_end;
+	clock_gettime(CLOCK_MONOTONIC,&wall_end);
+	
+	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
+	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
+	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
+	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
+	printf("%s:\n", what);
+	printf("  utime: %.3f\n", utime);
+	printf("  stime: %.3f\n", stime);
+	printf("  wall:  %.3f\n", wall_end.tv_sec-wall_start.tv_sec + (wall_end.tv_nsec-wall_start.tv_nsec)/1000000000.0);
+}
+
 
 int main(void) {
 	printf("Running...\n");
-	rusage ru_start;
-	getrusage(RUSAGE_SELF,&ru_start);
 	
 	std::string s;
 	auto append = [](const char *src, size_t srcsize, void *append_context) {
 		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
 	};
 	
+	start_timing();
 	for(int i=0; i<1000; i++) {
 		s.clear();
 		ijson2::DirectFormatter df(append,&s);
@@ -33,23 +61,196 @@ int main(void) {
 			df.append_array_member_separator();
 			df.open_object();
 			df.close_object();
+			df.append_array_member_separator();
 			df.open_array();
+			df.close_array();
 		}
 		df.close_array();
 		df.close_object();
 		
 		df.flush();
 	}
+	stop_timing("DirectFormatter");
 	
-	rusage ru_end;
-	getrusage(RUSAGE_SELF,&ru_end);
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::CallbackSink sink(append,&s);
+		ijson2::CompactDirectFormatter<> df(sink);
+		
+		df.open_object();
+		df.member("foo");
+		df.open_array();
+		for(int j=0; j<10000; j++) {
+			df.append_null();
+			df.append_string("boo");
+			df.append_number(17.0);
+			df.append_number(117);
+			df.open_object();
+			df.close_object();
+			df.open_array();
+			df.close_array();
+		}
+		df.close_array();
+		df.close_object();
+		
+		df.finish();
+	}
+	stop_timing("CompactDirectFormatter<CallbackSink>");
 	
-	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
-	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
-	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
-	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
-	printf("utime: %.3f\n", utime);
-	printf("stime: %.3f\n", stime);
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+		
+		df.open_object();
+		df.member("foo");
+		df.open_array();
+		for(int j=0; j<10000; j++) {
+			df.append_null();
+			df.append_string("boo");
+			df.append_number(17.0);
+			df.append_number(117);
+			df.open_object();
+			df.close_object();
+			df.open_array();
+			df.close_array();
+		}
+		df.close_array();
+		df.close_object();
+		
+		df.finish();
+	}
+	stop_timing("CompactDirectFormatter<StringSink>");
+	
+	//small responses of a fixed shape
+	start_timing();
+	for(int i=0; i<1000000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+		df.open_object();
+		df.member("status");
+		df.append_string("ok");
+		df.member("request_id");
+		df.append_number(i);
+		df.member("result");
+		df.open_object();
+		df.member("name");
+		df.append_string("some name");
+		df.member("balance");
+		df.append_number(i*0.25);
+		df.member("currency");
+		df.append_string("EUR");
+		df.member("flags");
+		df.open_array();
+		df.append_boolean(true);
+		df.append_boolean(false);
+		df.close_array();
+		df.close_object();
+		df.close_object();
+		df.finish();
+	}
+	stop_timing("responses, CompactDirectFormatter<StringSink>");
+	
+	ijson2::TemplateBuilder tb;
+	tb.open_object();
+	tb.member("status");
+	tb.append_string("ok");
+	tb.member("request_id");
+	tb.placeholder();
+	tb.member("result");
+	tb.open_object();
+	tb.member("name");
+	tb.placeholder();
+	tb.member("balance");
+	tb.placeholder();
+	tb.member("currency");
+	tb.append_string("EUR");
+	tb.member("flags");
+	tb.open_array();
+	tb.append_boolean(true);
+	tb.append_boolean(false);
+	tb.close_array();
+	tb.close_object();
+	tb.close_object();
+	ijson2::PreparedTemplate response_template = tb.finish();
+	start_timing();
+	for(int i=0; i<1000000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		response_template.render_to(sink,{i, "some name", i*0.25});
+	}
+	stop_timing("responses, PreparedTemplate");
+	
+	//arrays of objects with the same members
+	static const char *const member_names[20] = {
+		"id", "name", "created", "modified", "owner", "group", "size", "type", "status", "priority",
+		"parent_id", "description", "tags", "version", "checksum", "region", "quota", "used", "enabled", "comment"
+	};
+	start_timing();
+	for(int i=0; i<100; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+		df.open_array();
+		for(int j=0; j<10000; j++) {
+			df.open_object();
+			for(int k=0; k<20; k++) {
+				df.member(member_names[k]);
+				df.append_number(j+k);
+			}
+			df.close_object();
+		}
+		df.close_array();
+		df.finish();
+	}
+	stop_timing("homogeneous objects, CompactDirectFormatter<StringSink>");
+	
+	std::vector<ijson2::PreparedKey> member_keys;
+	for(int k=0; k<20; k++)
+		member_keys.emplace_back(member_names[k]);
+	start_timing();
+	for(int i=0; i<100; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+		df.open_array();
+		for(int j=0; j<10000; j++) {
+			df.open_object();
+			for(int k=0; k<20; k++) {
+				df.member(member_keys[k]);
+				df.append_number(j+k);
+			}
+			df.close_object();
+		}
+		df.close_array();
+		df.finish();
+	}
+	stop_timing("homogeneous objects, CompactDirectFormatter<StringSink> with PreparedKey");
+	
+	//output which takes a while, like a disk or a network
+	auto slow_append = [](const char *, size_t srcsize, void *) {
+		usleep(static_cast<useconds_t>(srcsize/64)); //64 MB/s
+	};
+	for(int background=0; background<2; background++) {
+		start_timing();
+		for(int i=0; i<100; i++) {
+			ijson2::BackgroundSink sink(slow_append,nullptr);
+			ijson2::DirectFormatter df = background ? ijson2::DirectFormatter(sink) : ijson2::DirectFormatter(slow_append,nullptr);
+			df.open_array();
+			for(int j=0; j<10000; j++) {
+				if(j!=0) df.append_array_member_separator();
+				df.append_string("a string of moderate length");
+				df.append_array_member_separator();
+				df.append_number(17.42);
+			}
+			df.close_array();
+			df.flush();
+		}
+		stop_timing(background ? "slow output, DirectFormatter with BackgroundSink" : "slow output, DirectFormatter");
+	}
 
 	return 0;
 }
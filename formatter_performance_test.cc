@@ -1,9 +1,37 @@
 #include "ijson2_formatter.hh"
+#include "ijson2_sink.hh"
+#include "ijson2_parallel_formatter.hh"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <sys/resource.h>
 
+
+static rusage ru_start;
+static timespec wall_start;
+
+static void start_timing() {
+	getrusage(RUSAGE_SELF,&ru_start);
+	clock_gettime(CLOCK_MONOTONIC,&wall_start);
+}
+
+static void stop_timing(const char *what) {
+	rusage ru_end;
+	getrusage(RUSAGE_SELF,&ru_end);
+	timespec wall_end;
+	clock_gettime(CLOCK_MONOTONIC,&wall_end);
+	
+	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
+	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
+	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
+	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
+	printf("%s:\n", what);
+	printf("  utime: %.3f\n", utime);
+	printf("  stime: %.3f\n", stime);
+	printf("  wall:  %.3f\n", wall_end.tv_sec-wall_start.tv_sec + (wall_end.tv_nsec-wall_start.tv_nsec)/1000000000.0);
+}
+
+
 int main(void) {
 	//build a large complex object
 	printf("Building object\n");
@@ -20,28 +48,92 @@ int main(void) {
 	}
 	
 	printf("Running...\n");
-	rusage ru_start;
-	getrusage(RUSAGE_SELF,&ru_start);
-	
 	std::string s;
 	auto append = [](const char *src, size_t srcsize, void *append_context) {
 		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
 	};
 	
+	start_timing();
 	for(int i=0; i<1000; i++) {
 		s.clear();
 		ijson2::format(o0, append,&s);
 	}	
+	stop_timing("format() with callback");
 	
-	rusage ru_end;
-	getrusage(RUSAGE_SELF,&ru_end);
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::format_to(sink,o0);
+	}
+	stop_timing("format_to() with StringSink");
 	
-	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
-	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
-	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
-	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
-	printf("utime: %.3f\n", utime);
-	printf("stime: %.3f\n", stime);
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s = ijson2::format_to_string(o0);
+	}
+	stop_timing("format_to_string()");
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s = ijson2::format_parallel_to_string(o0);
+	}
+	stop_timing("format_parallel_to_string()");
+	
+	//a big static section plus a small dynamic part
+	ijson2::Value response(ijson2::Value::map_type{});
+	response.object()["static"] = o0;
+	response.object()["dynamic"] = 42;
+	response.object()["static"].share();
+	ijson2::memoize_compact(static_cast<const ijson2::Value&>(response).at("static"));
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::format_to(sink,response);
+	}
+	stop_timing("memoized static section, format_to() with StringSink");
+	
+	//arrays of objects with the same members, the most common output shape
+	static const char *const member_names[20] = {
+		"id", "name", "created", "modified", "owner", "group", "size", "type", "status", "priority",
+		"parent_id", "description", "tags", "version", "checksum", "region", "quota", "used", "enabled", "comment"
+	};
+	ijson2::Value records(ijson2::Value::array_type{});
+	for(int i=0; i<10000; i++) {
+		ijson2::Value r(ijson2::Value::map_type{});
+		for(int j=0; j<20; j++)
+			r.object()[member_names[j]] = i+j;
+		records.array().push_back(r);
+	}
+	start_timing();
+	for(int i=0; i<100; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::format_to(sink,records);
+	}
+	stop_timing("homogeneous objects, format_to() with StringSink");
+	
+	//documents with long string payloads
+	ijson2::Value o1(ijson2::Value::array_type{});
+	std::string payload(4000,'p');
+	for(int i=0; i<1000; i++)
+		o1.array().emplace_back(ijson2::string_view(payload.data(),payload.size()));
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		s.clear();
+		ijson2::StringSink sink(s);
+		ijson2::format_to(sink,o1);
+	}
+	stop_timing("long strings, format_to() with StringSink");
+	
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		ijson2::IovecSink sink;
+		ijson2::format_to(sink,o1);
+	}
+	stop_timing("long strings, format_to() with IovecSink");
 
 	return 0;
 }
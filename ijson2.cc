@@ -0,0 +1,292 @@
+#include "ijson2.hh"
+#include <string.h>
+
+
+using namespace ijson2;
+
+
+//Is the double an integer that fits in an int64?
+static bool double_as_int64(double d, int64_t *i) {
+	if(!(d>=-9223372036854775808.0 && d<9223372036854775808.0))
+		return false; //also NaN
+	int64_t tmp = static_cast<int64_t>(d);
+	if(static_cast<double>(tmp)!=d)
+		return false;
+	*i = tmp;
+	return true;
+}
+
+
+static bool number_equal(const Value &lhs, const Value &rhs) {
+	if(lhs.value_type==value_type_t::number_int64) {
+		if(rhs.value_type==value_type_t::number_int64)
+			return lhs.u.number_int64value==rhs.u.number_int64value;
+		int64_t i;
+		return double_as_int64(rhs.u.number_doublevalue,&i) && i==lhs.u.number_int64value;
+	} else {
+		if(rhs.value_type==value_type_t::number_double)
+			return lhs.u.number_doublevalue==rhs.u.number_doublevalue;
+		return number_equal(rhs,lhs);
+	}
+}
+
+
+static bool is_number(value_type_t t) {
+	return t==value_type_t::number_int64 || t==value_type_t::number_double;
+}
+
+
+bool ijson2::operator==(const Value &lhs, const Value &rhs) noexcept {
+	if(lhs.value_type!=rhs.value_type) {
+		if(is_number(lhs.value_type) && is_number(rhs.value_type))
+			return number_equal(lhs,rhs);
+		return false;
+	}
+	switch(lhs.value_type) {
+		case value_type_t::object: {
+			if(lhs.u.object_members==rhs.u.object_members)
+				return true;
+			const Value::map_type &l = lhs.object();
+			const Value::map_type &r = rhs.object();
+			if(l.size()!=r.size())
+				return false;
+			if(lhs.u.object_members && rhs.u.object_members) {
+				uint64_t lh = lhs.u.object_members->memoized_hash.load(std::memory_order_relaxed);
+				uint64_t rh = rhs.u.object_members->memoized_hash.load(std::memory_order_relaxed);
+				if(lh!=0 && rh!=0 && lh!=rh)
+					return false;
+			}
+			//maps are ordered so we can compare them pairwise
+			for(auto li=l.begin(), ri=r.begin(); li!=l.end(); ++li, ++ri) {
+				if(li->first!=ri->first || li->second!=ri->second)
+					return false;
+			}
+			return true;
+		}
+		case value_type_t::array: {
+			if(lhs.u.array_elements==rhs.u.array_elements)
+				return true;
+			const Value::array_type &l = lhs.array();
+			const Value::array_type &r = rhs.array();
+			if(l.size()!=r.size())
+				return false;
+			if(lhs.u.array_elements && rhs.u.array_elements) {
+				uint64_t lh = lhs.u.array_elements->memoized_hash.load(std::memory_order_relaxed);
+				uint64_t rh = rhs.u.array_elements->memoized_hash.load(std::memory_order_relaxed);
+				if(lh!=0 && rh!=0 && lh!=rh)
+					return false;
+			}
+			for(size_t i=0; i<l.size(); i++)
+				if(l[i]!=r[i])
+					return false;
+			return true;
+		}
+		case value_type_t::string:
+			return lhs.string()==rhs.string();
+		case value_type_t::boolean:
+			return lhs.u.bool_value==rhs.u.bool_value;
+		case value_type_t::number_double:
+		case value_type_t::number_int64:
+			return number_equal(lhs,rhs);
+		case value_type_t::null:
+			return true;
+		case value_type_t::raw_json:
+			return lhs.raw_json()==rhs.raw_json();
+	}
+	return false;
+}
+
+
+//The hash must be stable across runs and platforms, so we don't use std::hash
+
+static uint64_t mix(uint64_t h) {
+	//finalizer from MurmurHash3
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t combine(uint64_t h, uint64_t v) {
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+	return h;
+}
+
+static uint64_t load_le64(const char *p) {
+	const uint8_t *q = reinterpret_cast<const uint8_t*>(p);
+	return  static_cast<uint64_t>(q[0])      | static_cast<uint64_t>(q[1])<<8  |
+	        static_cast<uint64_t>(q[2])<<16  | static_cast<uint64_t>(q[3])<<24 |
+	        static_cast<uint64_t>(q[4])<<32  | static_cast<uint64_t>(q[5])<<40 |
+	        static_cast<uint64_t>(q[6])<<48  | static_cast<uint64_t>(q[7])<<56;
+}
+
+static uint64_t hash_string(string_view sv) {
+	const char *p = sv.data();
+	size_t n = sv.size();
+	uint64_t h = mix(n + 0x27d4eb2f165667c5ULL);
+	while(n>=8) {
+		h = combine(h, mix(load_le64(p)));
+		p += 8;
+		n -= 8;
+	}
+	if(n>0) {
+		uint64_t w = 0;
+		for(size_t i=0; i<n; i++)
+			w |= static_cast<uint64_t>(static_cast<uint8_t>(p[i]))<<(i*8);
+		h = combine(h, mix(w));
+	}
+	return mix(h);
+}
+
+enum hash_seed : uint64_t {
+	seed_object = 0x1000,
+	seed_array  = 0x2000,
+	seed_string = 0x3000,
+	seed_false  = 0x4000,
+	seed_true   = 0x4001,
+	seed_int    = 0x5000,
+	seed_double = 0x6000,
+	seed_null   = 0x7000,
+	seed_raw_json = 0x8000,
+};
+
+template<class N>
+static uint64_t memoized(const N *n, uint64_t (*compute)(const N*)) {
+	if(!n->shared)
+		return compute(n);
+	uint64_t h = n->memoized_hash.load(std::memory_order_relaxed);
+	if(h==0) {
+		h = compute(n);
+		n->memoized_hash.store(h,std::memory_order_relaxed);
+	}
+	return h;
+}
+
+static uint64_t hash_object(const Value::object_node *n) {
+	//sum of member hashes so the order doesn't matter
+	uint64_t sum = 0;
+	for(const auto &e : n->elements)
+		sum += mix(combine(hash_string(e.first), e.second.hash()));
+	return mix(combine(seed_object+n->elements.size(), sum));
+}
+
+static uint64_t hash_array(const Value::array_node *n) {
+	uint64_t h = mix(seed_array+n->elements.size());
+	for(const auto &e : n->elements)
+		h = combine(h, e.hash());
+	return mix(h);
+}
+
+
+uint64_t ijson2::Value::hash() const noexcept {
+	switch(value_type) {
+		case value_type_t::object:
+			if(!u.object_members)
+				return mix(combine(seed_object,0));
+			return memoized(u.object_members,hash_object);
+		case value_type_t::array:
+			if(!u.array_elements)
+				return mix(mix(seed_array));
+			return memoized(u.array_elements,hash_array);
+		case value_type_t::string:
+			return combine(seed_string,hash_string(string()));
+		case value_type_t::boolean:
+			return mix(u.bool_value ? seed_true : seed_false);
+		case value_type_t::number_double: {
+			int64_t i;
+			if(double_as_int64(u.number_doublevalue,&i))
+				return mix(combine(seed_int,static_cast<uint64_t>(i)));
+			uint64_t bits;
+			memcpy(&bits,&u.number_doublevalue,sizeof(bits));
+			return mix(combine(seed_double,bits));
+		}
+		case value_type_t::number_int64:
+			return mix(combine(seed_int,static_cast<uint64_t>(u.number_int64value)));
+		case value_type_t::null:
+			return mix(seed_null);
+		case value_type_t::raw_json:
+			return combine(seed_raw_json,hash_string(raw_json()));
+	}
+	return 0;
+}
+
+
+//Open-addressing hash table of the members. The table size is a power of two
+//and at least twice the number of members so probe sequences are short.
+struct ijson2::Value::member_index {
+	struct entry {
+		uint64_t hash;
+		const Value::map_type::value_type *member;
+	};
+	size_t mask;
+	entry *entries;
+	
+	explicit member_index(const Value::map_type &m)
+	  : mask(0),
+	    entries(nullptr)
+	{
+		size_t capacity = 16;
+		while(capacity < m.size()*2)
+			capacity *= 2;
+		mask = capacity-1;
+		entries = new entry[capacity]();
+		for(const auto &e : m) {
+			uint64_t h = hash_string(e.first);
+			size_t i = h & mask;
+			while(entries[i].member)
+				i = (i+1) & mask;
+			entries[i].hash = h;
+			entries[i].member = &e;
+		}
+	}
+	~member_index() {
+		delete[] entries;
+	}
+	const Value *find(string_view name) const {
+		uint64_t h = hash_string(name);
+		for(size_t i = h&mask; entries[i].member; i = (i+1)&mask) {
+			if(entries[i].hash==h && entries[i].member->first==name)
+				return &entries[i].member->second;
+		}
+		return nullptr;
+	}
+};
+
+
+void ijson2::Value::object_node::free_index() noexcept {
+	delete index.exchange(nullptr,std::memory_order_acq_rel);
+}
+
+
+const Value *ijson2::Value::find(string_view name) const {
+	if(value_type!=value_type_t::object)
+		throw unexpected_value_type(value_type_t::object, value_type);
+	const object_node *n = u.object_members;
+	if(!n)
+		return nullptr;
+	//only shared nodes are immutable, so only they can keep an index safely
+	if(n->elements.size()<object_index_threshold || !n->shared) {
+		auto iter = n->elements.find(name);
+		return iter!=n->elements.end() ? &iter->second : nullptr;
+	}
+	member_index *index = n->index.load(std::memory_order_acquire);
+	if(!index) {
+		//build it. Concurrent readers may race to build it; the first one wins
+		member_index *new_index = new member_index(n->elements);
+		if(n->index.compare_exchange_strong(index,new_index,std::memory_order_acq_rel))
+			index = new_index;
+		else
+			delete new_index;
+	}
+	return index->find(name);
+}
+
+
+const Value &ijson2::Value::at(string_view name) const {
+	const Value *v = find(name);
+	if(!v)
+		throw std::out_of_range("no such member");
+	return *v;
+}
@@ -2,15 +2,18 @@
 #define IJSON2_HH_
 #include "ijson2_string_view.hh"
 #include <inttypes.h>
+#include <stddef.h>
+#include <atomic>
 #include <map>
 #include <vector>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 
 
 namespace ijson2 {
 
-enum class value_type_t {
+enum class value_type_t : uint8_t {
 	object,
 	array,
 	string,
@@ -18,7 +21,21 @@ enum class value_type_t {
 	number_double,
 	number_int64,
 	null,
+	raw_json,  //already valid JSON text which is output verbatim
 };
+//What to do with NaN and infinity, which JSON cannot represent
+enum class nonfinite_policy_t {
+	error,  //throw nonfinite_number
+	null,   //output null
+	string  //output "NaN", "Infinity" or "-Infinity"
+};
+
+//Compact JSON text cached by memoize_compact() in ijson2_formatter.hh
+struct memoized_text {
+	std::string text;
+	nonfinite_policy_t nonfinite_policy;  //the text was formatted with
+};
+
 static const char *value_type_name[] = {
 	"object",
 	"array",
@@ -26,7 +43,8 @@ static const char *value_type_name[] = {
 	"boolean",
 	"number_double",
 	"number_int64",
-	"null"
+	"null",
+	"raw_json"
 };
 
 class unexpected_value_type : public std::runtime_error {
@@ -40,38 +58,181 @@ class Value {
 	void clear() noexcept {
 		switch(value_type) {
 			case value_type_t::object:
-				u.object_members.~map_type();
+				release_node(u.object_members);
 				break;
 			case value_type_t::array:
-				u.array_elements.~array_type();
+				release_node(u.array_elements);
 				break;
 			case value_type_t::string:
-				u.string_value.~string_view();
-				break;
 			case value_type_t::boolean:
 			case value_type_t::number_double:
 			case value_type_t::number_int64:
 			case value_type_t::null:
+			case value_type_t::raw_json:
 				break;
 		}
 		value_type = value_type_t::null;
 	}
+	template<class N>
+	static void release_node(N *n) noexcept {
+		//an unshared node has exactly one owner so we can skip the atomic decrement
+		if(n && (n->refcount.load(std::memory_order_acquire)==1 || n->refcount.fetch_sub(1,std::memory_order_acq_rel)==1))
+			delete n;
+	}
+	template<class N>
+	static N *copy_node(N *n) {
+		if(!n)
+			return nullptr;
+		if(n->shared) {
+			n->refcount.fetch_add(1,std::memory_order_relaxed);
+			return n;
+		}
+		return new N(n->elements);
+	}
+	//Make the node modifiable by this value only
+	template<class N>
+	static N *detach_node(N *n) {
+		if(!n)
+			return new N;
+		if(!n->shared) {
+			n->modified();
+			return n;
+		}
+		if(n->refcount.load(std::memory_order_acquire)==1) {
+			n->shared = false;
+			n->modified();
+			return n;
+		}
+		//clone one level. The children are shared so copying them is cheap
+		N *clone = new N(n->elements);
+		release_node(n);
+		return clone;
+	}
+	void copy_representation(const Value &v) noexcept {
+		value_type = v.value_type;
+		string_inline_size = v.string_inline_size;
+		for(unsigned i=0; i<sizeof(string_inline_chars); i++)
+			string_inline_chars[i] = v.string_inline_chars[i];
+		u = v.u;
+	}
+	//Take over the representation of v. Containers are left empty in v.
+	//Must only be called when this value has been cleared.
+	void steal(Value &v) noexcept {
+		copy_representation(v);
+		if(v.value_type==value_type_t::object)
+			v.u.object_members = nullptr;
+		else if(v.value_type==value_type_t::array)
+			v.u.array_elements = nullptr;
+	}
+	void copy_from(const Value &v) {
+		switch(v.value_type) {
+			case value_type_t::object:
+				u.object_members = copy_node(v.u.object_members);
+				value_type = value_type_t::object;
+				break;
+			case value_type_t::array:
+				u.array_elements = copy_node(v.u.array_elements);
+				value_type = value_type_t::array;
+				break;
+			case value_type_t::string:
+			case value_type_t::boolean:
+			case value_type_t::number_double:
+			case value_type_t::number_int64:
+			case value_type_t::null:
+			case value_type_t::raw_json:
+				copy_representation(v);
+				break;
+		}
+	}
+	//Short strings are stored inline starting at string_inline_chars and continuing into u
+	char *inline_string_data() noexcept {
+		return reinterpret_cast<char*>(this) + 2;
+	}
+	const char *inline_string_data() const noexcept {
+		return reinterpret_cast<const char*>(this) + 2;
+	}
+	void set_string(string_view sv) noexcept {
+		if(sv.size()<=max_inline_string_size) {
+			string_inline_size = static_cast<uint8_t>(sv.size());
+			char *dst = inline_string_data();
+			for(size_t i=0; i<sv.size(); i++)
+				dst[i] = sv[i];
+		} else {
+			//the length is stored in the 6 bytes otherwise used for inline characters
+			string_inline_size = string_out_of_line;
+			uint64_t l = sv.size();
+			for(unsigned i=0; i<sizeof(string_inline_chars); i++)
+				string_inline_chars[i] = static_cast<char>(l>>(i*8));
+			u.string_data = sv.data();
+		}
+		value_type = value_type_t::string;
+	}
+	string_view string_representation() const noexcept {
+		if(string_inline_size!=string_out_of_line)
+			return string_view(inline_string_data(), string_inline_size);
+		uint64_t l = 0;
+		for(unsigned i=0; i<sizeof(string_inline_chars); i++)
+			l |= static_cast<uint64_t>(static_cast<uint8_t>(string_inline_chars[i]))<<(i*8);
+		return string_view(u.string_data, static_cast<size_t>(l));
+	}
 public:
 	using map_type = std::map<string_view,Value>;
 	using array_type = std::vector<Value>;
 	
+	//strings up to this length are copied into the value itself instead of being referenced
+	static constexpr size_t max_inline_string_size = 14;
+	static constexpr uint8_t string_out_of_line = 0xff;
+	
+	//Arrays and objects are held in reference-counted nodes. A node is only
+	//referenced by more than one value after share() has been called on it.
+	//Shared nodes are immutable and are cloned when modified through the
+	//non-const accessors, so only the nodes on the modified path are copied.
+	template<class T>
+	struct node {
+		node() : refcount(1), shared(false), memoized_hash(0), memoized_compact(nullptr), elements() {}
+		explicit node(const T &t) : refcount(1), shared(false), memoized_hash(0), memoized_compact(nullptr), elements(t) {}
+		explicit node(T &&t) : refcount(1), shared(false), memoized_hash(0), memoized_compact(nullptr), elements(std::move(t)) {}
+		~node() { delete memoized_compact.load(std::memory_order_relaxed); }
+		std::atomic<unsigned> refcount;
+		bool shared;
+		mutable std::atomic<uint64_t> memoized_hash; //only used for shared nodes, 0=not computed
+		mutable std::atomic<memoized_text*> memoized_compact; //only used for shared nodes
+		T elements;
+		//the elements may be modified through the reference handed out
+		void modified() noexcept {
+			memoized_hash.store(0,std::memory_order_relaxed);
+			if(memoized_compact.load(std::memory_order_relaxed))
+				delete memoized_compact.exchange(nullptr,std::memory_order_acq_rel);
+		}
+	};
+	//Shared objects with many members get a hash index on the first lookup with find()/at()
+	struct member_index;
+	struct object_node : node<map_type> {
+		using node<map_type>::node;
+		~object_node() { free_index(); }
+		mutable std::atomic<member_index*> index{nullptr};
+		void modified() noexcept {
+			node<map_type>::modified();
+			if(index.load(std::memory_order_relaxed))
+				free_index();
+		}
+		void free_index() noexcept;
+	};
+	using array_node = node<array_type>;
+	static constexpr size_t object_index_threshold = 32;
+	
 	Value() noexcept
 	  : value_type(value_type_t::null)
 	{}
 	Value(const Value &v)
 	  : value_type(value_type_t::null)
 	{
-		*this = v;
+		copy_from(v);
 	}
-	Value(Value &&v)
+	Value(Value &&v) noexcept
 	  : value_type(value_type_t::null)
 	{
-		*this = std::move(v);
+		steal(v);
 	}
 	~Value() noexcept {
 		clear();
@@ -81,9 +242,9 @@ public:
 	  : value_type(value_type_t::null)
 	{}
 	Value(string_view sv) noexcept
-	  : value_type(value_type_t::string)
+	  : value_type(value_type_t::null)
 	{
-		u.string_value = sv;
+		set_string(sv);
 	}
 	explicit Value(bool b) noexcept
 	  : value_type(value_type_t::boolean)
@@ -100,15 +261,41 @@ public:
 	{
 		u.number_doublevalue = d;
 	}
-	Value(const array_type &a) {
-		new(&u.array_elements) array_type(a);
+	Value(const array_type &a)
+	  : value_type(value_type_t::null)
+	{
+		u.array_elements = a.empty() ? nullptr : new array_node(a);
+		value_type = value_type_t::array;
+	}
+	Value(array_type &&a)
+	  : value_type(value_type_t::null)
+	{
+		u.array_elements = a.empty() ? nullptr : new array_node(std::move(a));
 		value_type = value_type_t::array;
 	}
-	Value(const map_type &o) {
-		new(&u.object_members) map_type(o);
+	Value(const map_type &o)
+	  : value_type(value_type_t::null)
+	{
+		u.object_members = o.empty() ? nullptr : new object_node(o);
+		value_type = value_type_t::object;
+	}
+	Value(map_type &&o)
+	  : value_type(value_type_t::null)
+	{
+		u.object_members = o.empty() ? nullptr : new object_node(std::move(o));
 		value_type = value_type_t::object;
 	}
 	
+	//A value holding JSON text which is output verbatim by the formatters. The
+	//text is referenced like a string and is not checked, so it must be a
+	//valid JSON value. Raw values are compared and hashed by their text.
+	static Value from_raw_json(string_view json) noexcept {
+		Value v;
+		v.set_string(json);
+		v.value_type = value_type_t::raw_json;
+		return v;
+	}
+	
 	//delegating constructors ad nauseam
 	Value(int8_t i) noexcept : Value(static_cast<int64_t>(i)) {}
 	Value(uint8_t i) noexcept : Value(static_cast<int64_t>(i)) {}
@@ -121,51 +308,18 @@ public:
 	
 	Value& operator=(const Value &v) {
 		if(this!=&v) {
-			switch(v.value_type) {
-				case value_type_t::object:
-					return (*this) = v.u.object_members;
-				case value_type_t::array:
-					return (*this) = v.u.array_elements;
-				case value_type_t::string:
-					return (*this) = v.u.string_value;
-				case value_type_t::boolean:
-					return (*this) = v.u.bool_value;
-				case value_type_t::number_double:
-					return (*this) = v.u.number_doublevalue;
-				case value_type_t::number_int64:
-					return (*this) = v.u.number_int64value;
-				case value_type_t::null:
-					value_type = value_type_t::null;
-					break;
-			}
+			//copy first, v may be a member of this value
+			Value tmp(v);
+			clear();
+			steal(tmp);
 		}
 		return *this;
 	}
-	Value& operator=(Value &&v) {
+	Value& operator=(Value &&v) noexcept {
 		if(this!=&v) {
-			switch(v.value_type) {
-				case value_type_t::object:
-					clear();
-					new (&u.object_members) map_type(std::move(v.u.object_members));
-					value_type = value_type_t::object;
-					return *this;
-				case value_type_t::array:
-					clear();
-					new (&u.array_elements) array_type(std::move(v.u.array_elements));
-					value_type = value_type_t::array;
-					return *this;
-				case value_type_t::string:
-					return (*this) = v.u.string_value;
-				case value_type_t::boolean:
-					return (*this) = v.u.bool_value;
-				case value_type_t::number_double:
-					return (*this) = v.u.number_doublevalue;
-				case value_type_t::number_int64:
-					return (*this) = v.u.number_int64value;
-				case value_type_t::null:
-					value_type = value_type_t::null;
-					break;
-			}
+			Value tmp(std::move(v));
+			clear();
+			steal(tmp);
 		}
 		return *this;
 	}
@@ -177,8 +331,7 @@ public:
 	}
 	Value& operator=(string_view sv) noexcept {
 		clear();
-		u.string_value = sv;
-		value_type = value_type_t::string;
+		set_string(sv);
 		return *this;
 	}
 	Value& operator=(bool b) noexcept {
@@ -206,28 +359,37 @@ public:
 		return *this;
 	}
 	Value& operator=(const array_type &a) {
-		clear();
-		new(&u.array_elements) array_type(a);
-		value_type = value_type_t::array;
-		return *this;
+		return *this = Value(a);
+	}
+	Value& operator=(array_type &&a) {
+		return *this = Value(std::move(a));
 	}
 	Value& operator=(const map_type &o) {
-		clear();
-		new(&u.object_members) map_type(o);
-		value_type = value_type_t::object;
-		return *this;
+		return *this = Value(o);
+	}
+	Value& operator=(map_type &&o) {
+		return *this = Value(std::move(o));
 	}
 	Value& operator=(const char *s) noexcept {
 		return *this = string_view(s);
 	}
 	
+	//Make the tree immutable and shared: copies of it and of its sub-values
+	//only increment a reference count. Call it before handing the tree to
+	//other threads; the reference counting is thread-safe.
+	Value &share() noexcept;
+	bool is_shared() const noexcept;
+	
+	//The representation is 16 bytes. Containers are held by pointer (nullptr
+	//meaning empty), short strings are stored inline and the rest in u.
 	value_type_t value_type;
+	uint8_t string_inline_size;      //length of an inline string, or string_out_of_line
+	char string_inline_chars[6];     //start of an inline string, or the length of an out-of-line string
 	union U {
-		U() noexcept {}
-		~U() noexcept {}
-		std::map<string_view,Value> object_members;
-		std::vector<Value> array_elements;
-		string_view string_value;
+		object_node *object_members;
+		array_node *array_elements;
+		const char *string_data;         //out-of-line string
+		char string_inline_tail[8];      //rest of an inline string
 		bool bool_value;
 		double number_doublevalue;
 		int64_t number_int64value;
@@ -236,27 +398,42 @@ public:
 	const map_type &object() const {
 		if(value_type!=value_type_t::object)
 			throw unexpected_value_type(value_type_t::object, value_type);
-		return u.object_members;
+		if(!u.object_members) {
+			static const map_type empty_map;
+			return empty_map;
+		}
+		return u.object_members->elements;
 	}
 	map_type &object() {
 		if(value_type!=value_type_t::object)
 			throw unexpected_value_type(value_type_t::object, value_type);
-		return u.object_members;
+		u.object_members = detach_node(u.object_members);
+		return u.object_members->elements;
 	}
 	const array_type &array() const {
 		if(value_type!=value_type_t::array)
 			throw unexpected_value_type(value_type_t::array, value_type);
-		return u.array_elements;
+		if(!u.array_elements) {
+			static const array_type empty_array;
+			return empty_array;
+		}
+		return u.array_elements->elements;
 	}
 	array_type &array() {
 		if(value_type!=value_type_t::array)
 			throw unexpected_value_type(value_type_t::array, value_type);
-		return u.array_elements;
+		u.array_elements = detach_node(u.array_elements);
+		return u.array_elements->elements;
 	}
 	string_view string() const {
 		if(value_type!=value_type_t::string)
 			throw unexpected_value_type(value_type_t::string, value_type);
-		return u.string_value;
+		return string_representation();
+	}
+	string_view raw_json() const {
+		if(value_type!=value_type_t::raw_json)
+			throw unexpected_value_type(value_type_t::raw_json, value_type);
+		return string_representation();
 	}
 	bool boolean() const {
 		if(value_type!=value_type_t::boolean)
@@ -274,9 +451,76 @@ public:
 		return u.number_int64value;
 	}
 	bool is_null() const { return value_type==value_type_t::null; }
+	
+	//Look up an object member. Shared objects (see share()) with at least
+	//object_index_threshold members get a hash index on the first lookup,
+	//making further lookups O(1). Unshared objects may be modified through a
+	//reference obtained earlier, so they are always searched directly.
+	const Value *find(string_view name) const;
+	const Value &at(string_view name) const;
+	
+	//The cached compact JSON text of an array or object, or nullptr if there
+	//is none or it was formatted with another nonfinite policy
+	const std::string *memoized_compact(nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error) const noexcept {
+		const memoized_text *m = nullptr;
+		if(value_type==value_type_t::object && u.object_members)
+			m = u.object_members->memoized_compact.load(std::memory_order_acquire);
+		else if(value_type==value_type_t::array && u.array_elements)
+			m = u.array_elements->memoized_compact.load(std::memory_order_acquire);
+		if(!m || m->nonfinite_policy!=nonfinite_policy)
+			return nullptr;
+		return &m->text;
+	}
+	
+	//Stable 64-bit structural hash. Equal values have equal hashes, the order
+	//of object members doesn't matter and integral doubles hash like int64.
+	//The hash of shared subtrees is memoized.
+	uint64_t hash() const noexcept;
 };
 
+//Deep comparison. Numbers are compared by value, so 1 and 1.0 are equal.
+bool operator==(const Value &lhs, const Value &rhs) noexcept;
+inline bool operator!=(const Value &lhs, const Value &rhs) noexcept {
+	return !(lhs==rhs);
+}
+
+inline Value &Value::share() noexcept {
+	if(value_type==value_type_t::object && u.object_members && !u.object_members->shared) {
+		for(auto &e : u.object_members->elements)
+			e.second.share();
+		u.object_members->shared = true;
+	} else if(value_type==value_type_t::array && u.array_elements && !u.array_elements->shared) {
+		for(auto &e : u.array_elements->elements)
+			e.share();
+		u.array_elements->shared = true;
+	}
+	return *this;
+}
+
+inline bool Value::is_shared() const noexcept {
+	if(value_type==value_type_t::object)
+		return !u.object_members || u.object_members->shared;
+	else if(value_type==value_type_t::array)
+		return !u.array_elements || u.array_elements->shared;
+	else
+		return true;
+}
+
+static_assert(sizeof(Value)==16, "Value is expected to be 16 bytes");
+static_assert(std::is_nothrow_move_constructible<Value>::value && std::is_nothrow_move_assignable<Value>::value, "std::vector<Value> must be able to move elements");
+static_assert(offsetof(Value,string_inline_chars)==2 && offsetof(Value,u)==8, "unexpected Value layout");
+
 } //namespace
 
 
+namespace std {
+template<>
+struct hash<ijson2::Value> {
+	size_t operator()(const ijson2::Value &v) const noexcept {
+		return static_cast<size_t>(v.hash());
+	}
+};
+}
+
+
 #endif
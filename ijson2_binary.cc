@@ -0,0 +1,434 @@
+#include "ijson2_binary.hh"
+#include "ijson2_parser.hh"
+#include <string.h>
+#include <limits.h>
+#include <stdexcept>
+
+
+namespace {
+
+struct Context {
+	ijson2::append_fn_t append_pfn;
+	void *append_context;
+	char intermediate_buffer[16384];
+	size_t ibuf_used;
+	
+	Context(ijson2::append_fn_t append_pfn_, void *append_context_)
+	  : append_pfn(append_pfn_),
+	    append_context(append_context_),
+	    ibuf_used(0)
+	 {}
+	 
+	void append(const char *s, size_t l);
+	void flush();
+};
+
+void Context::append(const char *s, size_t l) {
+	if(ibuf_used+l<sizeof(intermediate_buffer)) {
+		memcpy(intermediate_buffer+ibuf_used, s, l);
+		ibuf_used += l;
+	} else {
+		if(ibuf_used>0)
+			append_pfn(intermediate_buffer,ibuf_used,append_context);
+		if(l<sizeof(intermediate_buffer)) {
+			memcpy(intermediate_buffer,s,l);
+			ibuf_used = l;
+		} else {
+			append_pfn(s,l,append_context);
+		}
+		
+	}
+}
+
+void Context::flush() {
+	if(ibuf_used>0)
+		append_pfn(intermediate_buffer,ibuf_used,append_context);
+	ibuf_used = 0;
+}
+
+} //anonymous namespace
+
+
+//MessagePack is big-endian
+static void put_be(char *dst, uint64_t v, unsigned bytes) {
+	for(unsigned i=0; i<bytes; i++)
+		dst[i] = static_cast<char>(v >> ((bytes-1-i)*8));
+}
+
+static uint64_t get_be(const char *src, unsigned bytes) {
+	uint64_t v = 0;
+	for(unsigned i=0; i<bytes; i++)
+		v = (v<<8) | static_cast<uint8_t>(src[i]);
+	return v;
+}
+
+
+//MessagePack sizes are at most 32 bits
+static void check_size(size_t sz) {
+	if(sz>0xffffffff)
+		throw std::length_error("String, array or object too large for MessagePack");
+}
+
+
+//Append a type byte followed by a size using the smallest of the three encodings
+static void encode_size(Context &context, size_t sz, char fix, size_t fix_max, char code16) {
+	check_size(sz);
+	char buf[5];
+	if(sz<=fix_max) {
+		buf[0] = static_cast<char>(fix|static_cast<char>(sz));
+		context.append(buf,1);
+	} else if(sz<=0xffff) {
+		buf[0] = code16;
+		put_be(buf+1,sz,2);
+		context.append(buf,3);
+	} else {
+		buf[0] = static_cast<char>(code16+1);
+		put_be(buf+1,sz,4);
+		context.append(buf,5);
+	}
+}
+
+
+static void encode_string(ijson2::string_view sv, Context &context) {
+	char buf[5];
+	size_t sz = sv.size();
+	check_size(sz);
+	if(sz<32) {
+		buf[0] = static_cast<char>(0xa0|sz);
+		context.append(buf,1);
+	} else if(sz<=0xff) {
+		buf[0] = static_cast<char>(0xd9);
+		buf[1] = static_cast<char>(sz);
+		context.append(buf,2);
+	} else if(sz<=0xffff) {
+		buf[0] = static_cast<char>(0xda);
+		put_be(buf+1,sz,2);
+		context.append(buf,3);
+	} else {
+		buf[0] = static_cast<char>(0xdb);
+		put_be(buf+1,sz,4);
+		context.append(buf,5);
+	}
+	context.append(sv.data(),sz);
+}
+
+
+static void encode_int64(int64_t i, Context &context) {
+	char buf[9];
+	if(i>=-32 && i<=127) {
+		buf[0] = static_cast<char>(i); //positive/negative fixint
+		context.append(buf,1);
+	} else if(i>=0) {
+		if(i<=0xff) {
+			buf[0] = static_cast<char>(0xcc);
+			put_be(buf+1,static_cast<uint64_t>(i),1);
+			context.append(buf,2);
+		} else if(i<=0xffff) {
+			buf[0] = static_cast<char>(0xcd);
+			put_be(buf+1,static_cast<uint64_t>(i),2);
+			context.append(buf,3);
+		} else if(i<=0xffffffff) {
+			buf[0] = static_cast<char>(0xce);
+			put_be(buf+1,static_cast<uint64_t>(i),4);
+			context.append(buf,5);
+		} else {
+			buf[0] = static_cast<char>(0xcf);
+			put_be(buf+1,static_cast<uint64_t>(i),8);
+			context.append(buf,9);
+		}
+	} else {
+		if(i>=INT8_MIN) {
+			buf[0] = static_cast<char>(0xd0);
+			put_be(buf+1,static_cast<uint64_t>(i),1);
+			context.append(buf,2);
+		} else if(i>=INT16_MIN) {
+			buf[0] = static_cast<char>(0xd1);
+			put_be(buf+1,static_cast<uint64_t>(i),2);
+			context.append(buf,3);
+		} else if(i>=INT32_MIN) {
+			buf[0] = static_cast<char>(0xd2);
+			put_be(buf+1,static_cast<uint64_t>(i),4);
+			context.append(buf,5);
+		} else {
+			buf[0] = static_cast<char>(0xd3);
+			put_be(buf+1,static_cast<uint64_t>(i),8);
+			context.append(buf,9);
+		}
+	}
+}
+
+
+static void encode_double(double d, Context &context) {
+	char buf[9];
+	float f = static_cast<float>(d);
+	if(static_cast<double>(f)==d) {
+		//float32 is enough
+		uint32_t u;
+		memcpy(&u,&f,sizeof(u));
+		buf[0] = static_cast<char>(0xca);
+		put_be(buf+1,u,4);
+		context.append(buf,5);
+	} else {
+		uint64_t u;
+		memcpy(&u,&d,sizeof(u));
+		buf[0] = static_cast<char>(0xcb);
+		put_be(buf+1,u,8);
+		context.append(buf,9);
+	}
+}
+
+
+static void encode(const ijson2::Value &v, Context &context) {
+	switch(v.value_type) {
+		case ijson2::value_type_t::object: {
+			const auto &o = v.object();
+			encode_size(context,o.size(),static_cast<char>(0x80),15,static_cast<char>(0xde));
+			for(const auto &e : o) {
+				encode_string(e.first,context);
+				encode(e.second,context);
+			}
+			break;
+		}
+		case ijson2::value_type_t::array: {
+			const auto &a = v.array();
+			encode_size(context,a.size(),static_cast<char>(0x90),15,static_cast<char>(0xdc));
+			for(const auto &e : a)
+				encode(e,context);
+			break;
+		}
+		case ijson2::value_type_t::string:
+			encode_string(v.string(),context);
+			break;
+		case ijson2::value_type_t::boolean:
+			context.append(v.u.bool_value ? "\xc3" : "\xc2",1);
+			break;
+		case ijson2::value_type_t::number_double:
+			encode_double(v.u.number_doublevalue,context);
+			break;
+		case ijson2::value_type_t::number_int64:
+			encode_int64(v.u.number_int64value,context);
+			break;
+		case ijson2::value_type_t::null:
+			context.append("\xc0",1);
+			break;
+		case ijson2::value_type_t::raw_json: {
+			//MessagePack has no such thing, so encode what the text represents
+			ijson2::Parser parser;
+			ijson2::string_view json = v.raw_json();
+			parser.parse(json.data(),json.size());
+			encode(parser.value(),context);
+			break;
+		}
+	}
+}
+
+
+void ijson2::encode_binary(const Value &v, ijson2::append_fn_t append_pfn, void *append_context) {
+	Context context(append_pfn,append_context);
+	::encode(v,context);
+	context.flush();
+}
+
+
+size_t ijson2::encode_binary(const Value &v, char *dst, size_t dstsize) {
+	struct context_t {
+		char *dst;
+		size_t dstsize;
+		size_t bytes;
+	} context{dst,dstsize,0};
+	append_fn_t append = [](const char *src, size_t srcsize, void *append_context_) {
+		context_t *append_context = reinterpret_cast<context_t*>(append_context_);
+		if(append_context->bytes+srcsize > append_context->dstsize)
+			throw insufficient_room();
+		memcpy(append_context->dst+append_context->bytes, src, srcsize);
+		append_context->bytes += srcsize;
+	};
+	encode_binary(v,append,&context);
+	return context.bytes;
+}
+
+
+
+const char *ijson2::BinaryParser::parse_array(const char *s, const char *end, size_t elements, Value *value, unsigned max_nesting_levels) {
+	value->u.array_elements = nullptr;
+	value->value_type = value_type_t::array;
+	if(elements==0)
+		return s;
+	if(max_nesting_levels==0)
+		throw too_many_levels(s);
+	//each element takes at least one byte, so don't trust larger sizes
+	if(elements>static_cast<size_t>(end-s))
+		throw truncated_binary(s);
+	Value::array_type &a = value->array();
+	a.resize(elements);
+	for(auto &e : a)
+		s = parse_value(s,end,&e,max_nesting_levels-1);
+	return s;
+}
+
+
+const char *ijson2::BinaryParser::parse_map(const char *s, const char *end, size_t members, Value *value, unsigned max_nesting_levels) {
+	value->u.object_members = nullptr;
+	value->value_type = value_type_t::object;
+	if(members==0)
+		return s;
+	if(max_nesting_levels==0)
+		throw too_many_levels(s);
+	if(members>static_cast<size_t>(end-s)/2)
+		throw truncated_binary(s);
+	Value::map_type &o = value->object();
+	for(size_t i=0; i<members; i++) {
+		string_view sv;
+		s = parse_string(s,end,&sv);
+		//our encoder writes the members in order so appending is the common case
+		Value &member = o.emplace_hint(o.end(),sv,Value())->second;
+		member = nullptr; //duplicate member names: last one wins
+		s = parse_value(s,end,&member,max_nesting_levels-1);
+	}
+	return s;
+}
+
+
+const char *ijson2::BinaryParser::parse_string(const char *s, const char *end, string_view *sv) {
+	if(s==end)
+		throw truncated_binary(s);
+	uint8_t c = static_cast<uint8_t>(*s);
+	const char *p = s+1;
+	size_t l;
+	if(c>=0xa0 && c<=0xbf)
+		l = c&0x1f;
+	else {
+		unsigned size_bytes;
+		switch(c) {
+			case 0xc4: case 0xd9: size_bytes = 1; break;
+			case 0xc5: case 0xda: size_bytes = 2; break;
+			case 0xc6: case 0xdb: size_bytes = 4; break;
+			default:
+				throw expected_string(s);
+		}
+		if(static_cast<size_t>(end-p)<size_bytes)
+			throw truncated_binary(s);
+		l = static_cast<size_t>(get_be(p,size_bytes));
+		p += size_bytes;
+	}
+	if(static_cast<size_t>(end-p)<l)
+		throw truncated_binary(s);
+	*sv = string_view(p,l);
+	return p+l;
+}
+
+
+const char *ijson2::BinaryParser::parse_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels) {
+	if(s==end)
+		throw truncated_binary(s);
+	uint8_t c = static_cast<uint8_t>(*s);
+	const char *p = s+1;
+	unsigned size_bytes = 0;
+	if(c<=0x7f) {
+		*value = static_cast<int64_t>(c);
+		return p;
+	} else if(c>=0xe0) {
+		*value = static_cast<int64_t>(static_cast<int8_t>(c));
+		return p;
+	} else if(c>=0x90 && c<=0x9f) {
+		return parse_array(p,end,c&0x0f,value,max_nesting_levels);
+	} else if(c>=0x80 && c<=0x8f) {
+		return parse_map(p,end,c&0x0f,value,max_nesting_levels);
+	}
+	
+	switch(c) {
+		case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+		case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
+		case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+		case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+		case 0xc4: case 0xc5: case 0xc6:
+		case 0xd9: case 0xda: case 0xdb: {
+			string_view sv;
+			p = parse_string(s,end,&sv);
+			*value = sv;
+			return p;
+		}
+		case 0xc0:
+			*value = nullptr;
+			return p;
+		case 0xc2:
+			*value = false;
+			return p;
+		case 0xc3:
+			*value = true;
+			return p;
+		case 0xcc: size_bytes = 1; break;
+		case 0xcd: size_bytes = 2; break;
+		case 0xce: size_bytes = 4; break;
+		case 0xcf: size_bytes = 8; break;
+		case 0xd0: size_bytes = 1; break;
+		case 0xd1: size_bytes = 2; break;
+		case 0xd2: size_bytes = 4; break;
+		case 0xd3: size_bytes = 8; break;
+		case 0xca: size_bytes = 4; break;
+		case 0xcb: size_bytes = 8; break;
+		case 0xdc: case 0xde: size_bytes = 2; break;
+		case 0xdd: case 0xdf: size_bytes = 4; break;
+		default:
+			throw unsupported_binary_type(s);
+	}
+	if(static_cast<size_t>(end-p)<size_bytes)
+		throw truncated_binary(s);
+	uint64_t v = get_be(p,size_bytes);
+	p += size_bytes;
+	
+	switch(c) {
+		case 0xcc:
+		case 0xcd:
+		case 0xce:
+		case 0xcf:
+			if(v>static_cast<uint64_t>(INT64_MAX))
+				throw unparseable_number(s);
+			*value = static_cast<int64_t>(v);
+			return p;
+		case 0xd0:
+			*value = static_cast<int64_t>(static_cast<int8_t>(v));
+			return p;
+		case 0xd1:
+			*value = static_cast<int64_t>(static_cast<int16_t>(v));
+			return p;
+		case 0xd2:
+			*value = static_cast<int64_t>(static_cast<int32_t>(v));
+			return p;
+		case 0xd3:
+			*value = static_cast<int64_t>(v);
+			return p;
+		case 0xca: {
+			uint32_t u = static_cast<uint32_t>(v);
+			float f;
+			memcpy(&f,&u,sizeof(f));
+			*value = static_cast<double>(f);
+			return p;
+		}
+		case 0xcb: {
+			double d;
+			memcpy(&d,&v,sizeof(d));
+			*value = d;
+			return p;
+		}
+		case 0xdc: case 0xdd:
+			return parse_array(p,end,static_cast<size_t>(v),value,max_nesting_levels);
+		default: //0xde, 0xdf
+			return parse_map(p,end,static_cast<size_t>(v),value,max_nesting_levels);
+	}
+}
+
+
+void ijson2::BinaryParser::parse(const char *s, size_t sz, unsigned max_nesting_levels) {
+	top_value = nullptr;
+	const char *e = parse_value(s,s+sz,&top_value,max_nesting_levels);
+	if(e!=s+sz)
+		throw junk(e);
+}
+
+
+ijson2::Document ijson2::BinaryParser::release() noexcept {
+	Document document(MemoryArena(),std::move(top_value));
+	top_value = nullptr;
+	return document;
+}
@@ -0,0 +1,58 @@
+#ifndef IJSON2_BINARY_HH_
+#define IJSON2_BINARY_HH_
+#include "ijson2.hh"
+#include "ijson2_formatter.hh"
+#include "ijson2_parser.hh"
+
+//Binary encoding of values in MessagePack format (https://msgpack.org/).
+//It is more compact than JSON text and much faster to encode and decode.
+
+namespace ijson2 {
+
+void encode_binary(const Value &v, append_fn_t pfn, void *append_context);
+
+size_t encode_binary(const Value &v, char *dst, size_t dstsize);
+
+
+//Decoder for MessagePack data.
+//Like Parser it retains references into the given data in the string_view items.
+//Only the types that can be produced from JSON are supported, plus float32 and
+//binary (which is decoded as a string).
+class BinaryParser {
+	Value top_value;
+public:
+	BinaryParser()
+	{}
+	BinaryParser(const BinaryParser&) = delete;
+	BinaryParser operator=(const BinaryParser&) = delete;
+	
+	void parse(const char *s, size_t sz, unsigned max_nesting_levels=64);
+	
+	const Value &value() const { return top_value; }
+	
+	Document release() noexcept;
+private:
+	const char *parse_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels);
+	const char *parse_array(const char *s, const char *end, size_t elements, Value *value, unsigned max_nesting_levels);
+	const char *parse_map(const char *s, const char *end, size_t members, Value *value, unsigned max_nesting_levels);
+	const char *parse_string(const char *s, const char *end, string_view *sv);
+};
+
+
+class truncated_binary : public parser_error {
+public:
+	truncated_binary(const char *where_arg)
+	  : parser_error("truncated binary data",where_arg)
+	  {}
+};
+
+class unsupported_binary_type : public parser_error {
+public:
+	unsupported_binary_type(const char *where_arg)
+	  : parser_error("unsupported binary type",where_arg)
+	  {}
+};
+
+} //namespace
+
+#endif
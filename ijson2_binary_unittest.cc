@@ -0,0 +1,206 @@
+#include "ijson2_binary.hh"
+#include "ijson2_parser.hh"
+#include "ijson2_formatter.hh"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <string>
+
+using namespace ijson2;
+
+
+static std::string encode(const Value &v) {
+	std::string s;
+	auto append = [](const char *src, size_t srcsize, void *append_context) {
+		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
+	};
+	encode_binary(v,append,&s);
+	return s;
+}
+
+static std::string format(const Value &v) {
+	std::string s;
+	auto append = [](const char *src, size_t srcsize, void *append_context) {
+		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
+	};
+	ijson2::format(v,append,&s);
+	return s;
+}
+
+//JSON -> Value -> binary -> Value -> JSON must give the same output as JSON -> Value -> JSON
+static void check_round_trip(const char *json, size_t json_size) {
+	Parser p;
+	p.parse(json,json_size);
+	std::string b = encode(p.value());
+	BinaryParser bp;
+	bp.parse(b.data(),b.size());
+	assert(bp.value()==p.value());
+	assert(format(bp.value())==format(p.value()));
+}
+
+static void check_round_trip(const char *json) {
+	check_round_trip(json,strlen(json));
+}
+
+
+int main(void) {
+	printf("Encoding scalars\n");
+	assert(encode(Value())=="\xc0");
+	assert(encode(Value(false))=="\xc2");
+	assert(encode(Value(true))=="\xc3");
+	assert(encode(Value(0))==std::string("\x00",1));
+	assert(encode(Value(17))=="\x11");
+	assert(encode(Value(-1))=="\xff");
+	assert(encode(Value(-32))=="\xe0");
+	assert(encode(Value(200))=="\xcc\xc8");
+	assert(encode(Value(-100))=="\xd0\x9c");
+	assert(encode(Value(70000))==std::string("\xce\x00\x01\x11\x70",5));
+	assert(encode(Value(INT64_C(1)<<40))==std::string("\xcf\x00\x00\x01\x00\x00\x00\x00\x00",9));
+	assert(encode(Value(INT64_MIN))==std::string("\xd3\x80\x00\x00\x00\x00\x00\x00\x00",9));
+	assert(encode(Value(1.5))==std::string("\xca\x3f\xc0\x00\x00",5));
+	assert(encode(Value(0.1))=="\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a");
+	assert(encode(Value("abc"))=="\xa3" "abc");
+	
+	printf("Encoding containers\n");
+	assert(encode(Value(Value::array_type{}))=="\x90");
+	assert(encode(Value(Value::map_type{}))=="\x80");
+	assert(encode(Value(Value::array_type{1,"a"}))=="\x92\x01\xa1" "a");
+	assert(encode(Value(Value::map_type{{"a",nullptr}}))=="\x81\xa1" "a\xc0");
+	{
+		Value v(Value::array_type{});
+		for(int i=0; i<20; i++)
+			v.array().push_back(i);
+		std::string b = encode(v);
+		assert(b.size()==3+20);
+		assert(b.substr(0,3)==std::string("\xdc\x00\x14",3));
+	}
+	{
+		std::string long_string(300,'x');
+		std::string b = encode(Value(long_string.c_str()));
+		assert(b.size()==3+300);
+		assert(b.substr(0,3)==std::string("\xda\x01\x2c",3));
+	}
+	{
+		char buf[4];
+		assert(encode_binary(Value("abc"),buf,sizeof(buf))==4);
+		try {
+			encode_binary(Value("abcd"),buf,sizeof(buf));
+			assert(false);
+		} catch(const insufficient_room &) {
+		}
+	}
+	
+	printf("Decoding\n");
+	{
+		BinaryParser bp;
+		bp.parse("\xca\x3f\xc0\x00\x00",5);
+		assert(bp.value().doublevalue()==1.5);
+		bp.parse("\xc4\x03xyz",5);
+		assert(bp.value().string()=="xyz");
+		bp.parse("\xcf\x00\x00\x01\x00\x00\x00\x00\x00",9);
+		assert(bp.value().int64value()==INT64_C(1)<<40);
+		bp.parse("\xd1\xff\x00",3);
+		assert(bp.value().int64value()==-256);
+	}
+	{
+		//strings reference the data directly
+		static const char data[] = "\x81\xa1" "a\xd9\x10" "0123456789abcdef";
+		BinaryParser bp;
+		bp.parse(data,sizeof(data)-1);
+		assert(bp.value().object().begin()->first.data()==data+2);
+		assert(bp.value().object().at("a").string().data()==data+5);
+		Document doc = bp.release();
+		assert(bp.value().is_null());
+		assert(doc.value().object().at("a").string()=="0123456789abcdef");
+	}
+	
+	printf("Decoding errors\n");
+	{
+		BinaryParser bp;
+		try {
+			bp.parse("\xa3" "ab",3);
+			assert(false);
+		} catch(const truncated_binary &) {
+		}
+		try {
+			bp.parse("\x92\x01",2);
+			assert(false);
+		} catch(const truncated_binary &) {
+		}
+		try {
+			bp.parse("\xdd\x7f\xff\xff\xff\x01",6);
+			assert(false);
+		} catch(const truncated_binary &) {
+		}
+		try {
+			bp.parse("\xc1",1);
+			assert(false);
+		} catch(const unsupported_binary_type &) {
+		}
+		try {
+			bp.parse("\x81\x01\x01",3);
+			assert(false);
+		} catch(const expected_string &) {
+		}
+		try {
+			bp.parse("\xcf\xff\x00\x00\x00\x00\x00\x00\x00",9);
+			assert(false);
+		} catch(const unparseable_number &) {
+		}
+		try {
+			bp.parse("\xc0\xc0",2);
+			assert(false);
+		} catch(const junk &) {
+		}
+		try {
+			bp.parse("\x91\x91\x91\x90",4,2);
+			assert(false);
+		} catch(const too_many_levels &) {
+		}
+		bp.parse("\x91\x91\x90",3,2);
+	}
+	
+	printf("Encoding raw JSON\n");
+	{
+		Parser p;
+		p.set_raw_members({"payload"});
+		static const char json[] = "{\"payload\":{\"a\":[1,\"x\"]},\"id\":7}";
+		p.parse(json,sizeof(json)-1);
+		Parser p2;
+		p2.parse(json,sizeof(json)-1);
+		assert(encode(p.value())==encode(p2.value()));
+	}
+	
+	printf("Lengths beyond 32 bits\n");
+	{
+		//only the length is looked at before the error
+		static const char c = 'x';
+		Value v(string_view(&c,size_t(0x100000000)));
+		try {
+			encode(v);
+			assert(false);
+		} catch(const std::length_error &) {
+		}
+	}
+	
+	printf("Round trips\n");
+	check_round_trip("null");
+	check_round_trip("[true,false,0,-1,127,128,-32,-33,255,256,65535,65536,-129,-32769,4294967296,-9223372036854775808,9223372036854775807]");
+	check_round_trip("[0.5,0.1,-1e300,1.5e-300,42.125]");
+	check_round_trip("{\"foo\":{\"boo\":[],\"goo\":{}},\"\":\"\",\"a\\nb\":\"x\\\"y\"}");
+	{
+		FILE *fp = fopen("performance_test_input.json", "r");
+		if(fp) {
+			std::string data;
+			char buf[4096];
+			size_t b;
+			while((b=fread(buf,1,sizeof(buf),fp))>0)
+				data.append(buf,b);
+			fclose(fp);
+			check_round_trip(data.data(),data.size());
+		}
+	}
+	
+	return 0;
+}
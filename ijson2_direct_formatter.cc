@@ -1,10 +1,21 @@
 #include "ijson2_direct_formatter.hh"
-#include "double-conversion/double-conversion/double-conversion.h"
+#include "ijson2_formatting.hh"
 #include <string.h>
 #include <math.h>
 
 
+ijson2::PreparedKey::PreparedKey(const string_view &name) {
+	StringSink sink(text);
+	formatting::append_member_name(name,sink);
+	sink.flush();
+}
+
+
 void ijson2::DirectFormatter::append(const char *s, size_t l) {
+	if(background_sink) {
+		background_sink->append(s,l);
+		return;
+	}
 	if(intermediate_buffer_used+l<sizeof(intermediate_buffer)) {
 		memcpy(intermediate_buffer+intermediate_buffer_used, s, l);
 		intermediate_buffer_used += l;
@@ -21,12 +32,24 @@ void ijson2::DirectFormatter::append(const char *s, size_t l) {
 }
 
 
+char *ijson2::DirectFormatter::reserve(size_t l) {
+	if(background_sink)
+		return background_sink->reserve(l);
+	if(intermediate_buffer_used+l>sizeof(intermediate_buffer)) {
+		append_pfn(intermediate_buffer,intermediate_buffer_used,append_context);
+		intermediate_buffer_used = 0;
+	}
+	return intermediate_buffer+intermediate_buffer_used;
+}
+
+
 void ijson2::DirectFormatter::append_indent(int indents) {
 	//yes, we use tabs. 
 	while(indents>0) {
 		static const char eight_tabs[8]={'\t','\t','\t','\t','\t','\t','\t','\t'};
-		append(eight_tabs, indents%8);
-		indents -= 8;
+		int n = indents<8 ? indents : 8;
+		append(eight_tabs, n);
+		indents -= n;
 	}
 }
 
@@ -91,42 +114,11 @@ void ijson2::DirectFormatter::append_string(const string_view &sv, bool raw) {
 		if(!raw && !suppress_indent) append_indent(level);
 	}
 	append("\"",1);
-	for(char c : sv) {
-		switch(c) {
-			case '"': //quotation mark
-				append("\\\"",2);
-				break;
-			case '\\': //reverse solidus
-				append("\\\\",2);
-				break;
-			//case '/': //why would you want to escape that?
-			case '\b': //backspace
-				append("\\b",2);
-				break;
-			case '\f': //form feed
-				append("\\f",2);
-				break;
-			case '\n': //newline
-				append("\\n",2);
-				break;
-			case '\r': //carriage return
-				append("\\r",2);
-				break;
-			case '\t': //tab
-				append("\\t",2);
-				break;
-			default:
-				if(static_cast<uint8_t>(c) >= 32) {
-					append(&c,1);
-				} else {
-					char buf[6+1];
-					buf[0] = '\\';
-					buf[1] = 'u';
-					sprintf(buf+2,"%04X", static_cast<uint8_t>(c));
-					append(buf,6);
-				}
-		}
-	}
+	struct Sink {
+		DirectFormatter *df;
+		void append(const char *s, size_t l) { df->append(s,l); }
+	} sink{this};
+	formatting::append_escaped(sv,sink);
 	append("\"",1);
 }
 
@@ -137,45 +129,30 @@ void ijson2::DirectFormatter::append_number(int64_t i) {
 		nl_indent_pending=false;
 		if(!suppress_indent) append_indent(level);
 	}
-#if 0
-	//the obvious way
-	char buf[64];
-	size_t l = sprintf(buf,"%" PRId64, i);
-	append(buf,l);
-#else
-	//the optimized way
-	if(i==0)
-		append("0",1);
-	else {
-		char buf[24];
-		char *p=buf;
-		char *p2 = buf+sizeof(buf);
-		uint64_t u;
-		if(i<0) {
-			*p++ = '-';
-			u = -i;
-		} else
-			u = i;
-		while(u!=0) {
-			auto q = u/10;
-			auto r = u%10;
-			*--p2 = '0'+r;
-			u = q;
-		}
-		auto digits = buf+sizeof(buf)-p2;
-		memmove(p,p2,digits);
-		append(buf,digits+(p-buf));
+	char *p = reserve(formatting::max_integer_length+1);
+	commit(formatting::format_int64(i,p)-p);
+}
+
+
+void ijson2::DirectFormatter::append_number(uint64_t u) {
+	if(pretty) {
+		if(nl_indent_pending) append("\n",1);
+		nl_indent_pending=false;
+		if(!suppress_indent) append_indent(level);
 	}
-#endif
+	char *p = reserve(formatting::max_integer_length);
+	commit(formatting::format_uint64(u,p)-p);
 }
 
 
 void ijson2::DirectFormatter::append_number(double d) {
 	//in many scenarios doubles are actually whole numbers
-	int64_t i = static_cast<int64_t>(d);
-	if(d == i) {
-		append_number(i);
-		return;
+	if(d>=-9223372036854775808.0 && d<9223372036854775808.0) {
+		int64_t i = static_cast<int64_t>(d);
+		if(d == i) {
+			append_number(i);
+			return;
+		}
 	}
 	
 	if(pretty) {
@@ -186,13 +163,8 @@ void ijson2::DirectFormatter::append_number(double d) {
 	switch(fpclassify(d)) {
 		case FP_NAN:
 		case FP_INFINITE: {
-			char buf[64];
-			size_t l = sprintf(buf,"%.18f", d);
-			if(memchr(buf,'e',l)==nullptr) {
-				while(l>=2 && buf[l-1]=='0' && buf[l-2]!='.')
-					l--;
-			}
-			append(buf,l);
+			char *p = reserve(formatting::max_nonfinite_length);
+			commit(formatting::format_nonfinite(d,nonfinite_policy,p)-p);
 			break;
 		}
 		case FP_ZERO:
@@ -200,17 +172,8 @@ void ijson2::DirectFormatter::append_number(double d) {
 			append("0",1);
 			break;
 		default: {
-			using namespace double_conversion;
-			DoubleToStringConverter dtsc(DoubleToStringConverter::NO_FLAGS,
-			                             "INF",
-						     "NAN",
-						     'e',
-						     -16, 16,
-						     16,16);
-			char buf[64];
-			StringBuilder sb(buf,sizeof(buf));
-			dtsc.ToShortest(d,&sb);
-			append(buf,sb.position());
+			char *p = reserve(formatting::max_double_length);
+			commit(formatting::format_double(d,p)-p);
 			break;
 		}
 	}
@@ -240,6 +203,16 @@ void ijson2::DirectFormatter::append_null() {
 }
 
 
+void ijson2::DirectFormatter::append_raw_json(const string_view &json) {
+	if(pretty) {
+		if(nl_indent_pending) append("\n",1);
+		nl_indent_pending=false;
+		if(!suppress_indent) append_indent(level);
+	}
+	append(json.data(),json.size());
+}
+
+
 
 void ijson2::DirectFormatter::begin_object_member(const string_view &sv) {
 	if(pretty) {
@@ -253,6 +226,18 @@ void ijson2::DirectFormatter::begin_object_member(const string_view &sv) {
 }
 
 
+void ijson2::DirectFormatter::begin_object_member(const PreparedKey &key) {
+	if(pretty) {
+		if(nl_indent_pending) append("\n",1);
+		nl_indent_pending=false;
+		append_indent(level);
+	}
+	string_view text = key.formatted();
+	append(text.data(),text.size());
+	suppress_indent = true;
+}
+
+
 void ijson2::DirectFormatter::append_object_member_separator() {
 	if(pretty) {
 		append(",\n",2);
@@ -276,4 +261,6 @@ void ijson2::DirectFormatter::flush() {
 	if(intermediate_buffer_used>0)
 		append_pfn(intermediate_buffer,intermediate_buffer_used,append_context);
 	intermediate_buffer_used = 0;
+	if(background_sink)
+		background_sink->flush();
 }
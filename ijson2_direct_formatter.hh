@@ -1,30 +1,60 @@
 #ifndef IJSON2_DIRECT_FORMATTER_HH_
 #define IJSON2_DIRECT_FORMATTER_HH_
 #include "ijson2_formatter.hh"
+#include "ijson2_sink.hh"
 
 //A JSON formatter to appends directly to an output buffer. If used incorrectly can produce incorrect output.
 
 namespace ijson2 {
 
+//An object member name formatted once (quoted, escaped and followed by the
+//colon) so that names output over and over, eg. in arrays of similar objects,
+//are written with a single copy.
+class PreparedKey {
+	std::string text;
+public:
+	explicit PreparedKey(const string_view &name);
+	explicit PreparedKey(const std::string &name) : PreparedKey(string_view(name.data(),name.size())) {}
+	explicit PreparedKey(const char *name) : PreparedKey(string_view(name)) {}
+	string_view formatted() const { return string_view(text.data(),text.size()); }
+};
+
 
 class DirectFormatter {
 	append_fn_t append_pfn;
 	void *append_context;
 	bool pretty;
+	nonfinite_policy_t nonfinite_policy;
 	char intermediate_buffer[16384];
 	size_t intermediate_buffer_used = 0;
 	int level = 0;
 	bool nl_indent_pending = false;
 	bool suppress_indent = false;
+	BackgroundSink *background_sink = nullptr; //output goes straight into its buffers instead of the intermediate buffer
 	void append(const char *s, size_t l);
+	char *reserve(size_t l); //room for writing up to l (small) bytes directly into the intermediate buffer
+	void commit(size_t l) {
+		if(background_sink)
+			background_sink->commit(l);
+		else
+			intermediate_buffer_used += l;
+	}
 	void append_indent(int indents);
 	void append_string(const string_view &sv, bool raw);
 public:
-	DirectFormatter(append_fn_t append_pfn_, void *append_context_, bool pretty_=false)
+	DirectFormatter(append_fn_t append_pfn_, void *append_context_, bool pretty_=false, nonfinite_policy_t nonfinite_policy_=nonfinite_policy_t::error)
 	  : append_pfn(append_pfn_),
 	    append_context(append_context_),
-	    pretty(pretty_)
+	    pretty(pretty_),
+	    nonfinite_policy(nonfinite_policy_)
 	{}
+	//Formats straight into the sink's buffers. Full buffers are written by its
+	//writer thread while formatting continues
+	DirectFormatter(BackgroundSink &sink, bool pretty_=false, nonfinite_policy_t nonfinite_policy_=nonfinite_policy_t::error)
+	  : DirectFormatter(nullptr,nullptr,pretty_,nonfinite_policy_)
+	{
+		background_sink = &sink;
+	}
 	
 	void open_object();
 	void open_array();
@@ -35,19 +65,198 @@ public:
 	void append_string(const char *s) { append_string(string_view(s)); }
 	void append_number(int64_t i);
 	void append_number(int32_t i) { append_number(static_cast<int64_t>(i)); }
-	void append_number(uint32_t i) { append_number(static_cast<int64_t>(i)); }
+	void append_number(uint32_t i) { append_number(static_cast<uint64_t>(i)); }
+	void append_number(uint64_t u);
 	void append_number(double d);
 	void append_boolean(bool b);
 	void append_null();
+	void append_raw_json(const string_view &json); //valid JSON text, output verbatim
 	void begin_object_member(const string_view &sv);
 	void begin_object_member(const std::string &s) { begin_object_member(string_view(s.data(),s.size())); }
 	void begin_object_member(const char *s) { begin_object_member(string_view(s)); }
+	void begin_object_member(const PreparedKey &key);
 	void append_object_member_separator();
 	void append_array_member_separator();
 	
 	void flush();
 };
 
+
+
+//A direct formatter with the layout chosen at compile time, writing into a
+//sink (see ijson2_sink.hh). It keeps track of the containers itself, so
+//separators are added automatically and calls which would produce invalid
+//JSON throw invalid_structure. The output is the same as format() produces for
+//the equivalent value tree. In the compact instantiation the layout code
+//disappears entirely.
+template<bool Pretty, class Sink=CallbackSink, unsigned MaxDepth=64>
+class BasicDirectFormatter {
+	enum class state_t : uint8_t {
+		array_first,    //no elements yet
+		array_next,
+		object_first,   //member name expected
+		object_next,    //member name expected
+		object_value,   //member name has been output, value expected
+		top,            //top-level value expected
+		done            //top-level value is complete
+	};
+	Sink &sink;
+	nonfinite_policy_t nonfinite_policy;
+	unsigned depth;
+	state_t states[MaxDepth+1];  //states[0] is the top level
+	
+	void newline_indent(unsigned level) {
+		sink.append("\n",1);
+		formatting::append_indent(sink,static_cast<int>(level));
+	}
+	void before_value() {
+		switch(states[depth]) {
+			case state_t::array_first:
+				if(Pretty) newline_indent(depth);
+				break;
+			case state_t::array_next:
+				sink.append(",",1);
+				if(Pretty) newline_indent(depth);
+				break;
+			case state_t::object_value:
+			case state_t::top:
+				break;
+			case state_t::object_first:
+			case state_t::object_next:
+				throw invalid_structure("Object member name expected");
+			case state_t::done:
+				throw invalid_structure("Top-level value already complete");
+		}
+	}
+	void after_value() {
+		switch(states[depth]) {
+			case state_t::array_first:   states[depth] = state_t::array_next; break;
+			case state_t::object_value:  states[depth] = state_t::object_next; break;
+			case state_t::top:           states[depth] = state_t::done; break;
+			default: break;
+		}
+	}
+	void open(char c, state_t state) {
+		before_value();
+		if(depth==MaxDepth)
+			throw invalid_structure("Too many levels");
+		sink.append(&c,1);
+		states[++depth] = state;
+	}
+	void close(char c, state_t first, state_t next) {
+		state_t state = states[depth];
+		if(depth==0 || (state!=first && state!=next))
+			throw invalid_structure(c==']' ? "No array to close" : "No object to close");
+		if(Pretty && state==next) newline_indent(depth-1);
+		sink.append(&c,1);
+		depth--;
+		after_value();
+	}
+	void before_member() {
+		switch(states[depth]) {
+			case state_t::object_first:
+				break;
+			case state_t::object_next:
+				sink.append(",",1);
+				break;
+			default:
+				throw invalid_structure("Not in an object or member value expected");
+		}
+		if(Pretty) newline_indent(depth);
+		states[depth] = state_t::object_value;
+	}
+public:
+	explicit BasicDirectFormatter(Sink &sink_, nonfinite_policy_t nonfinite_policy_=nonfinite_policy_t::error)
+	  : sink(sink_),
+	    nonfinite_policy(nonfinite_policy_),
+	    depth(0)
+	{
+		states[0] = state_t::top;
+	}
+	
+	void open_object() { open('{',state_t::object_first); }
+	void close_object() { close('}',state_t::object_first,state_t::object_next); }
+	void open_array() { open('[',state_t::array_first); }
+	void close_array() { close(']',state_t::array_first,state_t::array_next); }
+	
+	void member(const string_view &name) {
+		before_member();
+		formatting::append_member_name(name,sink);
+	}
+	void member(const std::string &name) { member(string_view(name.data(),name.size())); }
+	void member(const char *name) { member(string_view(name)); }
+	void member(const PreparedKey &key) {
+		before_member();
+		string_view text = key.formatted();
+		sink.append(text.data(),text.size());
+	}
+	
+	void append_string(const string_view &sv) {
+		before_value();
+		formatting::append_string(sv,sink);
+		after_value();
+	}
+	void append_string(const std::string &s) { append_string(string_view(s.data(),s.size())); }
+	void append_string(const char *s) { append_string(string_view(s)); }
+	void append_number(int64_t i) {
+		before_value();
+		formatting::append_int64(i,sink);
+		after_value();
+	}
+	void append_number(int32_t i) { append_number(static_cast<int64_t>(i)); }
+	void append_number(uint32_t i) { append_number(static_cast<uint64_t>(i)); }
+	void append_number(uint64_t u) {
+		before_value();
+		char *p = sink.reserve(formatting::max_integer_length);
+		sink.commit(formatting::format_uint64(u,p)-p);
+		after_value();
+	}
+	void append_number(double d) {
+		before_value();
+		formatting::append_double(d,sink,nonfinite_policy);
+		after_value();
+	}
+	void append_boolean(bool b) {
+		before_value();
+		if(b)
+			sink.append("true",4);
+		else
+			sink.append("false",5);
+		after_value();
+	}
+	void append_null() {
+		before_value();
+		sink.append("null",4);
+		after_value();
+	}
+	void append_raw_json(const string_view &json) {
+		before_value();
+		//unqualified, so sinks which refer to the text in place (IovecSink) are found
+		using formatting::append_unescaped;
+		append_unescaped(sink,json.data(),json.size());
+		after_value();
+	}
+	//A whole value tree, laid out as if it had been built with the calls above
+	void append_value(const Value &v) {
+		before_value();
+		formatting::format_value(v,sink,Pretty?static_cast<int>(depth):-1,nonfinite_policy);
+		after_value();
+	}
+	
+	//The top-level value must be complete. Flushes the sink
+	void finish() {
+		if(states[0]!=state_t::done)
+			throw invalid_structure("Incomplete output");
+		if(Pretty) sink.append("\n",1);
+		sink.flush();
+	}
+};
+
+template<class Sink=CallbackSink>
+using CompactDirectFormatter = BasicDirectFormatter<false,Sink>;
+template<class Sink=CallbackSink>
+using PrettyDirectFormatter = BasicDirectFormatter<true,Sink>;
+
 }
 
 #endif
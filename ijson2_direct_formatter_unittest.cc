@@ -1,10 +1,43 @@
 #include "ijson2_direct_formatter.hh"
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
+#include <inttypes.h>
 #include <string>
 
 using ijson2::DirectFormatter;
 
+
+//builds the value of the BasicDirectFormatter test below
+template<class DF>
+static void build(DF &df) {
+	df.open_object();
+	df.member("a");
+	df.open_array();
+	df.append_number(1);
+	df.append_string("x\ty");
+	df.open_array();
+	df.close_array();
+	df.open_object();
+	df.close_object();
+	df.close_array();
+	df.member("b");
+	df.open_object();
+	df.member("c");
+	df.append_number(0.5);
+	df.member(std::string("d"));
+	df.open_array();
+	df.append_boolean(true);
+	df.append_null();
+	df.close_array();
+	df.close_object();
+	df.member("e");
+	df.append_number(static_cast<uint64_t>(INT64_MAX));
+	df.close_object();
+	df.finish();
+}
+
+
 int main() {
 	std::string s;
 	auto append = [](const char *src, size_t srcsize, void *append_context) {
@@ -72,6 +105,30 @@ int main() {
 		df.flush();
 		assert(s=="-123456");
 	}
+	{
+		DirectFormatter df(append,&s);
+		s.clear();
+		df.append_number(INT64_MIN);
+		df.append_number(INT64_MAX);
+		df.append_number(UINT64_MAX);
+		df.append_number(UINT32_MAX);
+		df.flush();
+		assert(s=="-9223372036854775808" "9223372036854775807" "18446744073709551615" "4294967295");
+	}
+	{
+		//all digit counts and the boundaries between them
+		for(uint64_t u=1; u!=0 && u<=UINT64_MAX/10+1; u*=10) {
+			for(uint64_t x : {u-1,u,u+1,u*9,u*9+(u-1)}) {
+				DirectFormatter df(append,&s);
+				s.clear();
+				df.append_number(x);
+				df.flush();
+				char buf[32];
+				sprintf(buf,"%" PRIu64,x);
+				assert(s==buf);
+			}
+		}
+	}
 	
 	printf("formatting double\n");
 	{
@@ -102,6 +159,42 @@ int main() {
 		df.flush();
 		assert(s=="0.0042500000001");
 	}
+	{
+		DirectFormatter df(append,&s);
+		s.clear();
+		df.open_array();
+		df.append_number(1e300);
+		df.append_array_member_separator();
+		df.append_number(-1.5e-17);
+		df.append_array_member_separator();
+		df.append_number(1e20);
+		df.close_array();
+		df.flush();
+		assert(s=="[1e300,-1.5e-17,1e20]");
+	}
+	{
+		DirectFormatter df(append,&s);
+		s.clear();
+		try {
+			df.append_number(NAN);
+			assert(false);
+		} catch(const ijson2::nonfinite_number &) {
+		}
+	}
+	{
+		DirectFormatter df(append,&s,false,ijson2::nonfinite_policy_t::null);
+		s.clear();
+		df.append_number(-INFINITY);
+		df.flush();
+		assert(s=="null");
+	}
+	{
+		DirectFormatter df(append,&s,false,ijson2::nonfinite_policy_t::string);
+		s.clear();
+		df.append_number(NAN);
+		df.flush();
+		assert(s=="\"NaN\"");
+	}
 	
 	printf("formatting strings\n");
 	{
@@ -118,6 +211,13 @@ int main() {
 		df.flush();
 		assert(s=="\"fo\\no\"");
 	}
+	{
+		DirectFormatter df(append,&s);
+		s.clear();
+		df.append_string("a fairly long string with a \"quote\", a \\ and a control\x01" "character\x7f\xc3\xa6");
+		df.flush();
+		assert(s=="\"a fairly long string with a \\\"quote\\\", a \\\\ and a control\\u0001character\x7f\xc3\xa6\"");
+	}
 	
 	printf("formatting arrays\n");
 	{
@@ -163,5 +263,172 @@ int main() {
 		assert(s=="{\"foo\":\"abc\",\"boo\":17}" || s=="{\"boo\":17,\"foo\":\"abc\"}");
 	}
 	
+	printf("formatting raw JSON\n");
+	{
+		DirectFormatter df(append,&s);
+		s.clear();
+		df.open_array();
+		df.append_raw_json("{\"a\" : 1}");
+		df.append_array_member_separator();
+		df.append_number(17);
+		df.close_array();
+		df.flush();
+		assert(s=="[{\"a\" : 1},17]");
+	}
+	{
+		DirectFormatter df(append,&s,true);
+		s.clear();
+		df.open_object();
+		df.begin_object_member("payload");
+		df.append_raw_json("[1,2]");
+		df.close_object();
+		df.flush();
+		assert(s=="{\n\t\"payload\":[1,2]\n}\n");
+	}
+	
+	printf("compile-time layout with automatic separators\n");
+	{
+		ijson2::Value v{ijson2::Value::map_type{}};
+		v.object()["a"] = ijson2::Value::array_type{ijson2::Value(1),ijson2::Value("x\ty"),ijson2::Value::array_type{},ijson2::Value::map_type{}};
+		v.object()["b"] = ijson2::Value::map_type{};
+		v.object()["b"].object()["c"] = 0.5;
+		v.object()["b"].object()["d"] = ijson2::Value::array_type{ijson2::Value(true),ijson2::Value()};
+		v.object()["e"] = INT64_MAX;
+		{
+			s.clear();
+			ijson2::StringSink sink(s);
+			ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+			build(df);
+			assert(s==ijson2::format_to_string(v));
+		}
+		{
+			s.clear();
+			ijson2::CallbackSink sink(append,&s);
+			ijson2::PrettyDirectFormatter<> df(sink);
+			build(df);
+			assert(s==ijson2::format_to_string(v,true));
+		}
+		{
+			//whole values and scalars at the top level
+			s.clear();
+			ijson2::StringSink sink(s);
+			ijson2::PrettyDirectFormatter<ijson2::StringSink> df(sink);
+			df.open_array();
+			df.append_value(v);
+			df.append_raw_json("[1]");
+			df.close_array();
+			df.finish();
+			ijson2::Value a{ijson2::Value::array_type()};
+			a.array().push_back(v);
+			a.array().push_back(ijson2::Value::from_raw_json("[1]"));
+			assert(s==ijson2::format_to_string(a,true));
+			s.clear();
+			ijson2::StringSink sink2(s);
+			ijson2::CompactDirectFormatter<ijson2::StringSink> df2(sink2);
+			df2.append_string("top");
+			df2.finish();
+			assert(s=="\"top\"");
+		}
+		{
+			//long raw JSON is referred to in place by IovecSink, and uint32 takes the unsigned path
+			static const char payload[] = "{\"opaque\":\"a payload which is long enough to be referenced in place\"}";
+			ijson2::IovecSink sink;
+			ijson2::CompactDirectFormatter<ijson2::IovecSink> df(sink);
+			df.open_array();
+			df.append_raw_json(payload);
+			df.append_number(UINT32_MAX);
+			df.close_array();
+			df.finish();
+			std::string collected;
+			bool referenced = false;
+			for(const auto &iov : sink.iovecs()) {
+				collected.append(static_cast<const char*>(iov.iov_base),iov.iov_len);
+				if(iov.iov_base==payload)
+					referenced = true;
+			}
+			assert(collected==std::string("[")+payload+",4294967295]");
+			assert(referenced);
+		}
+		
+		//prepared member names give the same output
+		{
+			const ijson2::PreparedKey a("a"), tab("x\ty");
+			std::string expected;
+			for(int pretty=0; pretty<2; pretty++) {
+				s.clear();
+				ijson2::StringSink sink(s);
+				if(pretty) {
+					ijson2::PrettyDirectFormatter<ijson2::StringSink> df(sink);
+					df.open_object();
+					df.member(a);
+					df.append_number(1);
+					df.member(tab);
+					df.open_object();
+					df.member(a);
+					df.append_null();
+					df.close_object();
+					df.close_object();
+					df.finish();
+				} else {
+					ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+					df.open_object();
+					df.member(a);
+					df.append_number(1);
+					df.member(tab);
+					df.open_object();
+					df.member(a);
+					df.append_null();
+					df.close_object();
+					df.close_object();
+					df.finish();
+				}
+				ijson2::Value inner{ijson2::Value::map_type{}};
+				inner.object()["a"] = nullptr;
+				ijson2::Value outer{ijson2::Value::map_type{}};
+				outer.object()["a"] = 1;
+				outer.object()["x\ty"] = inner;
+				expected = ijson2::format_to_string(outer,pretty);
+				assert(s==expected);
+				
+				s.clear();
+				DirectFormatter df(append,&s,pretty);
+				df.open_object();
+				df.begin_object_member(a);
+				df.append_number(1);
+				df.append_object_member_separator();
+				df.begin_object_member(tab);
+				df.open_object();
+				df.begin_object_member(a);
+				df.append_null();
+				df.close_object();
+				df.close_object();
+				df.flush();
+				assert(s==expected);
+			}
+		}
+		
+		//misuse
+		auto misuse = [](void (*f)(ijson2::CompactDirectFormatter<ijson2::StringSink>&)) {
+			std::string out;
+			ijson2::StringSink sink(out);
+			ijson2::CompactDirectFormatter<ijson2::StringSink> df(sink);
+			try {
+				f(df);
+				assert(false);
+			} catch(const ijson2::invalid_structure &) {
+			}
+		};
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_object(); df.append_null(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_object(); df.member("a"); df.member("b"); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_object(); df.member("a"); df.close_object(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_array(); df.member("a"); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_array(); df.close_object(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.close_array(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.append_null(); df.append_null(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.open_array(); df.finish(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { df.finish(); });
+		misuse([](ijson2::CompactDirectFormatter<ijson2::StringSink> &df) { for(int i=0; i<65; i++) df.open_array(); });
+	}
+	
 	return 0;
 }
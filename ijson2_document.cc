@@ -0,0 +1,34 @@
+#include "ijson2_document.hh"
+#include <string.h>
+
+
+ijson2::string_view ijson2::Document::copy(string_view sv) {
+	if(sv.empty())
+		return string_view();
+	char *p = reinterpret_cast<char*>(memory_arena.alloc(sv.size(),1));
+	memcpy(p,sv.data(),sv.size());
+	return string_view(p,sv.size());
+}
+
+
+ijson2::Value ijson2::Document::string(string_view sv) {
+	if(sv.size()<=Value::max_inline_string_size)
+		return Value(sv);
+	else
+		return Value(copy(sv));
+}
+
+
+ijson2::Value &ijson2::Document::member(Value &object, string_view name) {
+	auto &members = object.object();
+	auto iter = members.find(name);
+	if(iter!=members.end())
+		return iter->second;
+	return members.emplace(copy(name),Value()).first->second;
+}
+
+
+void ijson2::Document::clear() {
+	top_value = nullptr;
+	memory_arena.clear();
+}
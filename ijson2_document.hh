@@ -0,0 +1,52 @@
+#ifndef IJSON2_DOCUMENT_HH_
+#define IJSON2_DOCUMENT_HH_
+#include "ijson2.hh"
+#include "ijson2_memory_arena.hh"
+#include <string>
+
+namespace ijson2 {
+
+//A value tree together with the memory for its strings.
+//Strings given to the document are copied into its memory arena (unless they
+//are short enough to be stored inline in a Value) so temporaries can be used
+//safely and without a heap allocation per string.
+class Document {
+	MemoryArena memory_arena;
+	Value top_value;
+public:
+	Document()
+	{}
+	//Take over a tree and the memory its strings live in
+	Document(MemoryArena &&memory_arena_, Value &&value_) noexcept
+	  : memory_arena(std::move(memory_arena_)),
+	    top_value(std::move(value_))
+	{}
+	Document(const Document&) = delete;
+	Document& operator=(const Document&) = delete;
+	Document(Document&&) noexcept = default;
+	Document& operator=(Document&&) noexcept = default;
+	
+	Value &value() { return top_value; }
+	const Value &value() const { return top_value; }
+	
+	//Copy the characters into the document
+	string_view copy(string_view sv);
+	string_view copy(const std::string &s) { return copy(string_view(s.data(),s.size())); }
+	
+	//Make a string value that lives as long as the document
+	Value string(string_view sv);
+	Value string(const std::string &s) { return string(string_view(s.data(),s.size())); }
+	Value string(const char *s) { return string(string_view(s)); }
+	
+	//Find or insert a member of an object. The name is copied if the member is inserted.
+	Value &member(Value &object, string_view name);
+	Value &member(Value &object, const std::string &name) { return member(object,string_view(name.data(),name.size())); }
+	Value &member(Value &object, const char *name) { return member(object,string_view(name)); }
+	
+	//Release the tree and the strings
+	void clear();
+};
+
+} //namespace
+
+#endif
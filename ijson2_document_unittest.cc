@@ -0,0 +1,52 @@
+#include "ijson2_document.hh"
+#include "ijson2_formatter.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+using namespace ijson2;
+
+int main(void) {
+	std::string s;
+	auto append = [](const char *src, size_t srcsize, void *append_context) {
+		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
+	};
+	
+	printf("Copying strings\n");
+	{
+		Document doc;
+		std::string tmp("a string that is too long to be stored inline");
+		string_view sv = doc.copy(tmp);
+		assert(sv==tmp.c_str());
+		assert(sv.data()!=tmp.data());
+		assert(doc.copy(string_view()).empty());
+	}
+	{
+		Document doc;
+		Value v0 = doc.string(std::string("short"));
+		assert(v0.string()=="short");
+		Value v1 = doc.string(std::string("a string that is too long to be stored inline"));
+		assert(v1.string()=="a string that is too long to be stored inline");
+	}
+	
+	printf("Building a document from temporaries\n");
+	{
+		Document doc;
+		doc.value() = Value::map_type{};
+		for(int i=0; i<3; i++) {
+			std::string name = "member-with-a-long-name-" + std::to_string(i);
+			doc.member(doc.value(),name) = doc.string("value-that-is-not-so-short-" + std::to_string(i));
+		}
+		doc.member(doc.value(),std::string("member-with-a-long-name-1")) = 17;
+		assert(doc.value().object().size()==3);
+		s.clear();
+		format(doc.value(),append,&s);
+		assert(s=="{\"member-with-a-long-name-0\":\"value-that-is-not-so-short-0\","
+		           "\"member-with-a-long-name-1\":17,"
+		           "\"member-with-a-long-name-2\":\"value-that-is-not-so-short-2\"}");
+		doc.clear();
+		assert(doc.value().is_null());
+	}
+	
+	return 0;
+}
@@ -0,0 +1,372 @@
+#include "ijson2_flat.hh"
+#include "ijson2_parser.hh"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <system_error>
+
+
+using namespace ijson2;
+
+
+static const char magic[8] = {'i','j','s','o','n','2','f','d'};
+static const uint32_t format_version = 1;
+static const size_t header_size = 40;
+static const size_t slot_size = 16;
+
+
+static uint32_t get_le32(const char *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	uint32_t v;
+	memcpy(&v,p,sizeof(v));
+	return v;
+#else
+	const uint8_t *q = reinterpret_cast<const uint8_t*>(p);
+	return static_cast<uint32_t>(q[0]) | static_cast<uint32_t>(q[1])<<8 | static_cast<uint32_t>(q[2])<<16 | static_cast<uint32_t>(q[3])<<24;
+#endif
+}
+
+static uint64_t get_le64(const char *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	uint64_t v;
+	memcpy(&v,p,sizeof(v));
+	return v;
+#else
+	return static_cast<uint64_t>(get_le32(p)) | static_cast<uint64_t>(get_le32(p+4))<<32;
+#endif
+}
+
+static void put_le32(char *p, uint32_t v) {
+	for(unsigned i=0; i<4; i++)
+		p[i] = static_cast<char>(v>>(i*8));
+}
+
+static void put_le64(char *p, uint64_t v) {
+	for(unsigned i=0; i<8; i++)
+		p[i] = static_cast<char>(v>>(i*8));
+}
+
+
+//Check that [offset..offset+bytes) is inside the document
+static void check_range(size_t size, uint64_t offset, uint64_t bytes) {
+	if(offset>size || bytes>size-offset)
+		throw invalid_flat_document();
+}
+
+//Check the element/member slots of the container in the slot. The builder
+//always puts them after the slot referring to them, which also rules out
+//cycles in corrupt documents
+static void check_children(size_t size, size_t slot, uint64_t offset, uint64_t bytes) {
+	if(offset<=slot)
+		throw invalid_flat_document();
+	check_range(size,offset,bytes);
+}
+
+
+uint32_t ijson2::FlatValue::count() const {
+	return get_le32(base+slot+4);
+}
+
+uint64_t ijson2::FlatValue::payload() const {
+	return get_le64(base+slot+8);
+}
+
+value_type_t ijson2::FlatValue::type() const {
+	uint32_t t = get_le32(base+slot);
+	if(t>static_cast<uint32_t>(value_type_t::null))
+		throw invalid_flat_document();
+	return static_cast<value_type_t>(t);
+}
+
+bool ijson2::FlatValue::boolean() const {
+	if(type()!=value_type_t::boolean)
+		throw unexpected_value_type(value_type_t::boolean, type());
+	return payload()!=0;
+}
+
+int64_t ijson2::FlatValue::int64value() const {
+	if(type()!=value_type_t::number_int64)
+		throw unexpected_value_type(value_type_t::number_int64, type());
+	return static_cast<int64_t>(payload());
+}
+
+double ijson2::FlatValue::doublevalue() const {
+	if(type()!=value_type_t::number_double)
+		throw unexpected_value_type(value_type_t::number_double, type());
+	uint64_t u = payload();
+	double d;
+	memcpy(&d,&u,sizeof(d));
+	return d;
+}
+
+string_view ijson2::FlatValue::string() const {
+	if(type()!=value_type_t::string)
+		throw unexpected_value_type(value_type_t::string, type());
+	uint32_t l = count();
+	uint64_t offset = payload();
+	check_range(size,offset,l);
+	return string_view(base+offset,l);
+}
+
+FlatArray ijson2::FlatValue::array() const {
+	if(type()!=value_type_t::array)
+		throw unexpected_value_type(value_type_t::array, type());
+	uint32_t n = count();
+	uint64_t offset = payload();
+	check_children(size,slot,offset,static_cast<uint64_t>(n)*slot_size);
+	return FlatArray(base,size,static_cast<size_t>(offset),n);
+}
+
+FlatObject ijson2::FlatValue::object() const {
+	if(type()!=value_type_t::object)
+		throw unexpected_value_type(value_type_t::object, type());
+	uint32_t n = count();
+	uint64_t offset = payload();
+	check_children(size,slot,offset,static_cast<uint64_t>(n)*slot_size*2);
+	return FlatObject(base,size,static_cast<size_t>(offset),n);
+}
+
+
+Value ijson2::FlatValue::to_value(unsigned max_nesting_levels) const {
+	//the builder gives every slot one parent, so a document has no more slots
+	//to visit than fit in it. Corrupt documents where several containers share
+	//their children could otherwise take exponential time
+	size_t slots_left = size/slot_size;
+	return to_value(max_nesting_levels,slots_left);
+}
+
+Value ijson2::FlatValue::to_value(unsigned max_nesting_levels, size_t &slots_left) const {
+	if(slots_left==0)
+		throw invalid_flat_document();
+	slots_left--;
+	switch(type()) {
+		case value_type_t::object: {
+			if(max_nesting_levels==0)
+				throw too_many_levels(base+slot);
+			Value v(Value::map_type{});
+			FlatObject o = object();
+			if(!o.empty()) {
+				Value::map_type &m = v.object();
+				for(size_t i=0; i<o.size(); i++)
+					m.emplace_hint(m.end(),o.name(i),o.value(i).to_value(max_nesting_levels-1,slots_left));
+			}
+			return v;
+		}
+		case value_type_t::array: {
+			if(max_nesting_levels==0)
+				throw too_many_levels(base+slot);
+			Value v(Value::array_type{});
+			FlatArray a = array();
+			if(!a.empty()) {
+				Value::array_type &elements = v.array();
+				elements.reserve(a.size());
+				for(size_t i=0; i<a.size(); i++)
+					elements.push_back(a[i].to_value(max_nesting_levels-1,slots_left));
+			}
+			return v;
+		}
+		case value_type_t::string:
+			return Value(string());
+		case value_type_t::boolean:
+			return Value(boolean());
+		case value_type_t::number_double:
+			return Value(doublevalue());
+		case value_type_t::number_int64:
+			return Value(int64value());
+		case value_type_t::null:
+		case value_type_t::raw_json: //never stored
+			break;
+	}
+	return Value();
+}
+
+
+FlatValue ijson2::FlatArray::at(size_t i) const {
+	if(i>=count)
+		throw std::out_of_range("FlatArray::at");
+	return (*this)[i];
+}
+
+
+bool ijson2::FlatObject::find(string_view name, FlatValue *value) const {
+	size_t lo = 0;
+	size_t hi = count;
+	while(lo<hi) {
+		size_t mid = lo + (hi-lo)/2;
+		int r = this->name(mid).compare(name);
+		if(r==0) {
+			*value = this->value(mid);
+			return true;
+		}
+		if(r<0)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+
+FlatValue ijson2::FlatObject::at(string_view name) const {
+	FlatValue v(base,size_,0);
+	if(!find(name,&v))
+		throw no_such_member();
+	return v;
+}
+
+
+ijson2::FlatDocument::FlatDocument(const void *data, size_t size_)
+  : base(reinterpret_cast<const char*>(data)),
+    size(size_)
+{
+	if(size<header_size ||
+	   memcmp(base,magic,sizeof(magic))!=0 ||
+	   get_le32(base+8)!=format_version ||
+	   get_le64(base+16)!=size)
+		throw invalid_flat_document();
+}
+
+
+ijson2::MappedFlatDocument::MappedFlatDocument(const char *filename)
+  : mapping(nullptr),
+    mapping_size(0),
+    document(nullptr)
+{
+	int fd = open(filename,O_RDONLY);
+	if(fd<0)
+		throw std::system_error(errno,std::system_category(),filename);
+	struct stat st;
+	if(fstat(fd,&st)!=0) {
+		int e = errno;
+		close(fd);
+		throw std::system_error(e,std::system_category(),filename);
+	}
+	mapping_size = static_cast<size_t>(st.st_size);
+	if(mapping_size==0) {
+		close(fd);
+		throw invalid_flat_document();
+	}
+	mapping = mmap(nullptr,mapping_size,PROT_READ,MAP_SHARED,fd,0);
+	int e = errno;
+	close(fd);
+	if(mapping==MAP_FAILED)
+		throw std::system_error(e,std::system_category(),filename);
+	try {
+		document = new FlatDocument(mapping,mapping_size);
+	} catch(...) {
+		munmap(mapping,mapping_size);
+		throw;
+	}
+}
+
+
+ijson2::MappedFlatDocument::~MappedFlatDocument() {
+	delete document;
+	munmap(mapping,mapping_size);
+}
+
+
+
+namespace {
+
+class FlatBuilder {
+public:
+	std::string buf;
+	
+	size_t alloc(size_t bytes, size_t alignment) {
+		size_t offset = (buf.size()+alignment-1)&~(alignment-1);
+		buf.resize(offset+bytes);
+		return offset;
+	}
+	void put_slot(size_t at, value_type_t t, size_t count, uint64_t payload) {
+		if(count>UINT32_MAX)
+			throw std::length_error("too large for a flat document");
+		put_le32(&buf[at],static_cast<uint32_t>(t));
+		put_le32(&buf[at+4],static_cast<uint32_t>(count));
+		put_le64(&buf[at+8],payload);
+	}
+	void put_string(size_t at, string_view sv) {
+		size_t offset = alloc(sv.size()+1,1);
+		memcpy(&buf[offset],sv.data(),sv.size());
+		put_slot(at,value_type_t::string,sv.size(),offset);
+	}
+	void put_value(size_t at, const Value &v);
+};
+
+void FlatBuilder::put_value(size_t at, const Value &v) {
+	switch(v.value_type) {
+		case value_type_t::object: {
+			const Value::map_type &o = v.object();
+			size_t offset = alloc(o.size()*slot_size*2,8);
+			put_slot(at,value_type_t::object,o.size(),offset);
+			for(const auto &e : o) {
+				put_string(offset,e.first);
+				put_value(offset+slot_size,e.second);
+				offset += slot_size*2;
+			}
+			break;
+		}
+		case value_type_t::array: {
+			const Value::array_type &a = v.array();
+			size_t offset = alloc(a.size()*slot_size,8);
+			put_slot(at,value_type_t::array,a.size(),offset);
+			for(const auto &e : a) {
+				put_value(offset,e);
+				offset += slot_size;
+			}
+			break;
+		}
+		case value_type_t::string:
+			put_string(at,v.string());
+			break;
+		case value_type_t::boolean:
+			put_slot(at,value_type_t::boolean,0,v.u.bool_value?1:0);
+			break;
+		case value_type_t::number_double: {
+			uint64_t u;
+			memcpy(&u,&v.u.number_doublevalue,sizeof(u));
+			put_slot(at,value_type_t::number_double,0,u);
+			break;
+		}
+		case value_type_t::number_int64:
+			put_slot(at,value_type_t::number_int64,0,static_cast<uint64_t>(v.u.number_int64value));
+			break;
+		case value_type_t::null:
+			put_slot(at,value_type_t::null,0,0);
+			break;
+		case value_type_t::raw_json: {
+			//stored as what the text represents
+			Parser parser;
+			string_view json = v.raw_json();
+			parser.parse(json.data(),json.size());
+			put_value(at,parser.value());
+			break;
+		}
+	}
+}
+
+} //anonymous namespace
+
+
+std::string ijson2::make_flat(const Value &v) {
+	FlatBuilder builder;
+	builder.alloc(header_size,8);
+	memcpy(&builder.buf[0],magic,sizeof(magic));
+	put_le32(&builder.buf[8],format_version);
+	put_le32(&builder.buf[12],0);
+	builder.put_value(24,v);
+	builder.alloc(0,8);
+	put_le64(&builder.buf[16],builder.buf.size());
+	return builder.buf;
+}
+
+
+std::string ijson2::make_flat(const char *json, size_t json_size, unsigned max_nesting_levels) {
+	Parser parser;
+	parser.parse(json,json_size,max_nesting_levels);
+	return make_flat(parser.value());
+}
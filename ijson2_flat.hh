@@ -0,0 +1,137 @@
+#ifndef IJSON2_FLAT_HH_
+#define IJSON2_FLAT_HH_
+#include "ijson2.hh"
+#include <stdexcept>
+#include <string>
+
+//A relocatable binary document format which can be memory-mapped and read in
+//place through the view classes below without deserialization.
+//
+//All integers are little-endian and all offsets are from the start of the document.
+//  header (40 bytes):
+//    0: magic "ijson2fd"
+//    8: uint32 format version (1)
+//   12: uint32 reserved (0)
+//   16: uint64 total size of the document
+//   24: slot of the top-level value
+//  slot (16 bytes, 8-byte aligned):
+//    0: uint32 value type (value_type_t)
+//    4: uint32 count: string length, number of array elements or object members
+//    8: uint64 payload: 0/1 for booleans, the int64 or the double, or the offset of
+//       the characters of a string (followed by a NUL), the element slots of an
+//       array, or the member slot pairs (name, value) of an object sorted by name.
+
+namespace ijson2 {
+
+class FlatArray;
+class FlatObject;
+
+class FlatValue {
+	const char *base;
+	size_t size;
+	size_t slot;
+	friend class FlatDocument;
+	friend class FlatArray;
+	friend class FlatObject;
+	FlatValue(const char *base_, size_t size_, size_t slot_)
+	  : base(base_), size(size_), slot(slot_)
+	{}
+	uint32_t count() const;
+	uint64_t payload() const;
+	Value to_value(unsigned max_nesting_levels, size_t &slots_left) const;
+public:
+	value_type_t type() const;
+	bool is_null() const { return type()==value_type_t::null; }
+	bool boolean() const;
+	int64_t int64value() const;
+	double doublevalue() const;
+	string_view string() const;
+	FlatArray array() const;
+	FlatObject object() const;
+	
+	//Convert to a value tree. Strings reference the document. Deeper nesting
+	//throws too_many_levels (see ijson2_parser.hh)
+	Value to_value(unsigned max_nesting_levels=64) const;
+};
+
+class FlatArray {
+	const char *base;
+	size_t size_;
+	size_t elements;
+	uint32_t count;
+	friend class FlatValue;
+	FlatArray(const char *base_, size_t size__, size_t elements_, uint32_t count_)
+	  : base(base_), size_(size__), elements(elements_), count(count_)
+	{}
+public:
+	size_t size() const { return count; }
+	bool empty() const { return count==0; }
+	FlatValue operator[](size_t i) const { return FlatValue(base,size_,elements+i*16); }
+	FlatValue at(size_t i) const;
+};
+
+class FlatObject {
+	const char *base;
+	size_t size_;
+	size_t members;
+	uint32_t count;
+	friend class FlatValue;
+	FlatObject(const char *base_, size_t size__, size_t members_, uint32_t count_)
+	  : base(base_), size_(size__), members(members_), count(count_)
+	{}
+public:
+	size_t size() const { return count; }
+	bool empty() const { return count==0; }
+	//members are ordered by name
+	string_view name(size_t i) const { return FlatValue(base,size_,members+i*32).string(); }
+	FlatValue value(size_t i) const { return FlatValue(base,size_,members+i*32+16); }
+	//binary search. Returns false if there is no such member
+	bool find(string_view name, FlatValue *value) const;
+	FlatValue at(string_view name) const;
+};
+
+
+//A view of a flat document in memory. The memory must outlive the view.
+class FlatDocument {
+	const char *base;
+	size_t size;
+public:
+	FlatDocument(const void *data, size_t size_);
+	FlatValue value() const { return FlatValue(base,size,24); }
+	const char *data() const { return base; }
+};
+
+
+//A flat document in a memory-mapped file
+class MappedFlatDocument {
+	void *mapping;
+	size_t mapping_size;
+	FlatDocument *document;
+	MappedFlatDocument(const MappedFlatDocument&) = delete;
+	MappedFlatDocument& operator=(const MappedFlatDocument&) = delete;
+public:
+	MappedFlatDocument(const char *filename);
+	~MappedFlatDocument();
+	FlatValue value() const { return document->value(); }
+};
+
+
+//Make a flat document from a value tree
+std::string make_flat(const Value &v);
+//Make a flat document from JSON text
+std::string make_flat(const char *json, size_t json_size, unsigned max_nesting_levels=64);
+
+
+class invalid_flat_document : public std::runtime_error {
+public:
+	invalid_flat_document() : std::runtime_error("invalid or truncated flat document") {}
+};
+
+class no_such_member : public std::out_of_range {
+public:
+	no_such_member() : std::out_of_range("no such member") {}
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,196 @@
+#include "ijson2_flat.hh"
+#include "ijson2_parser.hh"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+using namespace ijson2;
+
+
+int main(void) {
+	printf("Scalars\n");
+	{
+		std::string f = make_flat(Value());
+		assert(f.size()==40);
+		FlatDocument doc(f.data(),f.size());
+		assert(doc.value().is_null());
+	}
+	{
+		std::string f = make_flat(Value(true));
+		assert(FlatDocument(f.data(),f.size()).value().boolean()==true);
+		f = make_flat(Value(-17));
+		assert(FlatDocument(f.data(),f.size()).value().int64value()==-17);
+		f = make_flat(Value(42.5));
+		assert(FlatDocument(f.data(),f.size()).value().doublevalue()==42.5);
+		f = make_flat(Value("a string which is not inline"));
+		assert(FlatDocument(f.data(),f.size()).value().string()=="a string which is not inline");
+		try {
+			FlatDocument(f.data(),f.size()).value().int64value();
+			assert(false);
+		} catch(const unexpected_value_type &) {
+		}
+	}
+	
+	printf("Containers\n");
+	{
+		static const char json[] = "{\"foo\":[17,\"abc\",true,null,{}],\"boo\":{\"x\":1,\"y\":2.5,\"z\":[]},\"\":\"empty\"}";
+		std::string f = make_flat(json,sizeof(json)-1);
+		assert(f.size()%8==0);
+		FlatDocument doc(f.data(),f.size());
+		FlatObject o = doc.value().object();
+		assert(o.size()==3);
+		assert(o.name(0)=="");
+		assert(o.name(1)=="boo");
+		assert(o.name(2)=="foo");
+		assert(o.at("").string()=="empty");
+		FlatArray a = o.at("foo").array();
+		assert(a.size()==5);
+		assert(a[0].int64value()==17);
+		assert(a[1].string()=="abc");
+		assert(a[2].boolean());
+		assert(a[3].is_null());
+		assert(a[4].object().empty());
+		assert(o.at("boo").object().at("y").doublevalue()==2.5);
+		assert(o.at("boo").object().at("z").array().empty());
+		FlatValue v = o.at("foo");
+		assert(!o.find("goo",&v));
+		try {
+			o.at("goo");
+			assert(false);
+		} catch(const no_such_member &) {
+		}
+		try {
+			a.at(5);
+			assert(false);
+		} catch(const std::out_of_range &) {
+		}
+		
+		//strings in the document are NUL-terminated
+		assert(strcmp(a[1].string().data(),"abc")==0);
+		
+		Parser p;
+		p.parse(json,sizeof(json)-1);
+		assert(doc.value().to_value()==p.value());
+	}
+	
+	printf("Large objects\n");
+	{
+		Value v(Value::map_type{});
+		std::string names[1000];
+		for(int i=0; i<1000; i++) {
+			names[i] = "member" + std::to_string(i);
+			v.object()[names[i].c_str()] = i;
+		}
+		std::string f = make_flat(v);
+		FlatObject o = FlatDocument(f.data(),f.size()).value().object();
+		for(int i=0; i<1000; i++)
+			assert(o.at(names[i].c_str()).int64value()==i);
+	}
+	
+	printf("Invalid documents\n");
+	{
+		std::string f = make_flat(Value(Value::array_type{1,2,3}));
+		try {
+			FlatDocument(f.data(),f.size()-8);
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+		std::string g(f);
+		g[0] = 'x';
+		try {
+			FlatDocument(g.data(),g.size());
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+		//array pointing outside the document
+		g = f;
+		g[28] = 100;
+		try {
+			FlatDocument(g.data(),g.size()).value().array();
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+		//array containing itself
+		g = make_flat("[1]",3);
+		g[32] = 24;
+		try {
+			FlatDocument(g.data(),g.size()).value().to_value();
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+		//nested array pointing back at the top-level slot
+		g = make_flat("[[1]]",5);
+		assert(g[48]==56);
+		g[48] = 24;
+		try {
+			FlatDocument(g.data(),g.size()).value().to_value();
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+		//both array slots of every level point at the next level, doubling the
+		//work with each level. The leaves are two nulls
+		static const size_t levels = 21;
+		g = f.substr(0,40);
+		g.resize(40+32*(levels+1),'\0');
+		auto put = [&g](size_t pos, uint64_t v, unsigned bytes) {
+			for(unsigned i=0; i<bytes; i++)
+				g[pos+i] = static_cast<char>(v>>(i*8));
+		};
+		put(16,g.size(),8);
+		put(28,2,4);
+		put(32,40,8);
+		for(size_t level=0; level<=levels; level++) {
+			for(size_t j=0; j<2; j++) {
+				size_t slot = 40+32*level+16*j;
+				if(level<levels) {
+					put(slot,static_cast<uint32_t>(value_type_t::array),4);
+					put(slot+4,2,4);
+					put(slot+8,slot-16*j+32,8);
+				} else
+					put(slot,static_cast<uint32_t>(value_type_t::null),4);
+			}
+		}
+		assert(g.size()==744);
+		assert(FlatDocument(g.data(),g.size()).value().array()[1].array()[0].array().size()==2);
+		try {
+			FlatDocument(g.data(),g.size()).value().to_value();
+			assert(false);
+		} catch(const invalid_flat_document &) {
+		}
+	}
+	
+	printf("Nesting limit\n");
+	{
+		std::string json = std::string(70,'[') + std::string(70,']');
+		std::string f = make_flat(json.data(),json.size(),100);
+		FlatDocument doc(f.data(),f.size());
+		try {
+			doc.value().to_value();
+			assert(false);
+		} catch(const too_many_levels &) {
+		}
+		Value v = doc.value().to_value(70);
+		assert(v.array()[0].array()[0].value_type==value_type_t::array);
+	}
+	
+	printf("Memory-mapped file\n");
+	{
+		char filename[] = "/tmp/ijson2_flat_unittest_XXXXXX";
+		int fd = mkstemp(filename);
+		assert(fd>=0);
+		std::string f = make_flat("[\"abc\",{\"def\":117}]",19);
+		assert(write(fd,f.data(),f.size())==static_cast<ssize_t>(f.size()));
+		close(fd);
+		{
+			MappedFlatDocument doc(filename);
+			assert(doc.value().array()[0].string()=="abc");
+			assert(doc.value().array()[1].object().at("def").int64value()==117);
+		}
+		unlink(filename);
+	}
+	
+	return 0;
+}
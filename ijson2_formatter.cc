@@ -1,279 +1,225 @@
 #include "ijson2_formatter.hh"
-#include "double-conversion/double-conversion/double-conversion.h"
-#include <string.h>
-#include <float.h>
+#include "ijson2_sink.hh"
 #include <math.h>
 
 
 namespace {
 
-struct Context {
-	ijson2::append_fn_t append_pfn;
-	void *append_context;
-	char intermediate_buffer[16384];
-	size_t ibuf_used;
-	
-	Context(ijson2::append_fn_t append_pfn_, void *append_context_)
-	  : append_pfn(append_pfn_),
-	    append_context(append_context_),
-	    ibuf_used(0)
-	 {}
-	 
-	void append(const char *s, size_t l);
-	void flush();
+//Writes into a buffer known to be big enough, so without any checks. This
+//relies on the formatting functions never writing past the end of the final
+//output: writes into reserved room which aren't committed (see
+//append_member_name()) must stay within what the following output overwrites.
+class UncheckedBufferSink {
+	char *p;
+public:
+	explicit UncheckedBufferSink(char *dst) : p(dst) {}
+	char *reserve(size_t) { return p; }
+	void commit(size_t l) { p += l; }
+	void append(const char *s, size_t l) {
+		memcpy(p,s,l);
+		p += l;
+	}
+	void flush() {}
 };
 
-void Context::append(const char *s, size_t l) {
-	if(ibuf_used+l<sizeof(intermediate_buffer)) {
-		memcpy(intermediate_buffer+ibuf_used, s, l);
-		ibuf_used += l;
-	} else {
-		if(ibuf_used>0)
-			append_pfn(intermediate_buffer,ibuf_used,append_context);
-		if(l<sizeof(intermediate_buffer)) {
-			memcpy(intermediate_buffer,s,l);
-			ibuf_used = l;
-		} else {
-			append_pfn(s,l,append_context);
-		}
+//Like BufferSink but without exceptions: output which doesn't fit is only
+//counted, and NaN/infinity which cannot be output is only noted.
+class ReportingBufferSink {
+	char *dst;
+	size_t dstsize;
+	size_t used;
+	char scratch[64];  //for reservations near the end of the buffer
+	bool in_scratch;
+	bool overflow;
+	bool nonfinite;
+public:
+	ReportingBufferSink(char *dst_, size_t dstsize_) : dst(dst_), dstsize(dstsize_), used(0), in_scratch(false), overflow(false), nonfinite(false) {}
+	char *reserve(size_t l) {
+		in_scratch = overflow || dstsize-used<l;
+		return in_scratch ? scratch : dst+used;
 	}
-}
+	void commit(size_t l) {
+		if(in_scratch) {
+			in_scratch = false;
+			append(scratch,l);
+		} else
+			used += l;
+	}
+	void append(const char *s, size_t l) {
+		if(!overflow && dstsize-used>=l)
+			memcpy(dst+used,s,l);
+		else
+			overflow = true;
+		used += l;
+	}
+	void flush() {}
+	void nonfinite_error() { nonfinite = true; }
+	
+	ijson2::format_result result() const {
+		if(nonfinite)
+			return ijson2::format_result{ijson2::format_errc::nonfinite_number,used};
+		if(overflow)
+			return ijson2::format_result{ijson2::format_errc::insufficient_room,used};
+		return ijson2::format_result{ijson2::format_errc::ok,used};
+	}
+};
 
-void Context::flush() {
-	if(ibuf_used>0)
-		append_pfn(intermediate_buffer,ibuf_used,append_context);
-	ibuf_used = 0;
+inline void nonfinite_error(ReportingBufferSink &sink) {
+	sink.nonfinite_error();
 }
 
 } //anonymous namespace
 
 
-static void format(const ijson2::Value &v, Context &context, int level);
+void ijson2::format(const Value &v, ijson2::append_fn_t append_pfn, void *append_context, bool pretty, nonfinite_policy_t nonfinite_policy) {
+	CallbackSink sink(append_pfn,append_context);
+	format_to(sink,v,pretty,nonfinite_policy);
+}
 
 
-static void append_indent(Context &context, int level) {
-	//yes, we use tabs. 
-	while(level>0) {
-		static const char eight_tabs[8]={'\t','\t','\t','\t','\t','\t','\t','\t'};
-		context.append(eight_tabs, level%8);
-		level -= 8;
+size_t ijson2::format(const Value &v, char *dst, size_t dstsize, bool pretty, nonfinite_policy_t nonfinite_policy) {
+	format_result r = try_format(v,dst,dstsize,pretty,nonfinite_policy);
+	switch(r.error) {
+		case format_errc::ok:
+			break;
+		case format_errc::insufficient_room:
+			throw insufficient_room();
+		case format_errc::nonfinite_number:
+			throw nonfinite_number();
 	}
+	return r.size;
 }
 
 
+ijson2::format_result ijson2::try_format(const Value &v, char *dst, size_t dstsize, bool pretty, nonfinite_policy_t nonfinite_policy) noexcept {
+	ReportingBufferSink sink(dst,dstsize);
+	format_to(sink,v,pretty,nonfinite_policy);
+	return sink.result();
+}
 
 
-static void format_string(const ijson2::string_view sv, Context &context) {
-	context.append("\"",1);
-	for(char c : sv) {
-		switch(c) {
-			case '"': //quotation mark
-				context.append("\\\"",2);
-				break;
-			case '\\': //reverse solidus
-				context.append("\\\\",2);
-				break;
-			//case '/': //why would you want to escape that?
-			case '\b': //backspace
-				context.append("\\b",2);
-				break;
-			case '\f': //form feed
-				context.append("\\f",2);
-				break;
-			case '\n': //newline
-				context.append("\\n",2);
-				break;
-			case '\r': //carriage return
-				context.append("\\r",2);
-				break;
-			case '\t': //tab
-				context.append("\\t",2);
-				break;
-			default:
-				if(static_cast<uint8_t>(c) >= 32) {
-					context.append(&c,1);
-				} else {
-					char buf[6+1];
-					buf[0] = '\\';
-					buf[1] = 'u';
-					sprintf(buf+2,"%04X", static_cast<uint8_t>(c));
-					context.append(buf,6);
-				}
-		}
-	}
-	context.append("\"",1);
-}
+//The measuring mirrors the formatting templates in ijson2_sink.hh but only
+//computes lengths, which is considerably cheaper for strings and doubles.
 
+static size_t indent_size(int level) {
+	return level>0 ? level : 0;
+}
 
-static void format_int64(int64_t i, Context &context) {
-#if 0
-	//the obvious way
-	char buf[64];
-	size_t l = sprintf(buf,"%" PRId64, i);
-	context.append(buf,l);
-#else
-	//the optimized way
-	if(i==0)
-		context.append("0",1);
-	else {
-		char buf[24];
-		char *p=buf;
-		char *p2 = buf+sizeof(buf);
-		uint64_t u;
-		if(i<0) {
-			*p++ = '-';
-			u = -i;
-		} else
-			u = i;
-		while(u!=0) {
-			auto q = u/10;
-			auto r = u%10;
-			*--p2 = '0'+r;
-			u = q;
-		}
-		auto digits = buf+sizeof(buf)-p2;
-		memmove(p,p2,digits);
-		context.append(buf,digits+(p-buf));
+static size_t string_size(const ijson2::string_view &sv) {
+	size_t size = 2+sv.size();
+	const char *s = sv.data();
+	size_t l = sv.size();
+	for(;;) {
+		size_t clean = ijson2::formatting::unescaped_prefix_length(s,l);
+		if(clean==l)
+			break;
+		size += ijson2::formatting::escape_sequence[static_cast<uint8_t>(s[clean])].length-1;
+		s += clean+1;
+		l -= clean+1;
 	}
-#endif
+	return size;
 }
 
+static size_t int64_size(int64_t i) {
+	char buf[ijson2::formatting::max_integer_length+1];
+	return ijson2::formatting::format_int64(i,buf)-buf;
+}
 
-static void format_double(double d, Context &context) {
-	int64_t i = static_cast<int64_t>(d);
-	if(d == i) {
-		format_int64(i,context);
-		return;
+static size_t double_size(double d, ijson2::nonfinite_policy_t nonfinite_policy) {
+	if(d>=-9223372036854775808.0 && d<9223372036854775808.0) {
+		int64_t i = static_cast<int64_t>(d);
+		if(d == i)
+			return int64_size(i);
 	}
-	
 	switch(fpclassify(d)) {
 		case FP_NAN:
 		case FP_INFINITE: {
-			char buf[64];
-			size_t l = sprintf(buf,"%.18f", d);
-			if(memchr(buf,'e',l)==nullptr) {
-				while(l>=2 && buf[l-1]=='0' && buf[l-2]!='.')
-					l--;
-			}
-			context.append(buf,l);
-			break;
+			char buf[ijson2::formatting::max_nonfinite_length];
+			return ijson2::formatting::format_nonfinite(d,nonfinite_policy,buf)-buf;
 		}
 		case FP_ZERO:
 		case FP_SUBNORMAL:
-			context.append("0",1);
-			break;
-		default: {
-			using namespace double_conversion;
-			DoubleToStringConverter dtsc(DoubleToStringConverter::NO_FLAGS,
-			                             "INF",
-						     "NAN",
-						     'e',
-						     -16, 16,
-						     16,16);
-			char buf[64];
-			StringBuilder sb(buf,sizeof(buf));
-			dtsc.ToShortest(d,&sb);
-			context.append(buf,sb.position());
-			break;
-		}
+			return 1;
+		default:
+			return ijson2::formatting::double_length(d);
 	}
 }
 
-
-static void format_array(const ijson2::Value::array_type &a, Context &context, int level) {
-	if(a.empty()) {
-		context.append("[]",2);
-	} else {
-		context.append("[",1);
-		bool first=true;
-		for(const auto &e : a) {
-			if(!first)
-				context.append(",",1);
-			if(level>=0) context.append("\n",1);
-			append_indent(context,level>=0?level+1:level);
-			format(e,context,level>=0?level+1:level);
-			first = false;
-		}
-		if(level>=0) context.append("\n",1);
-		append_indent(context,level);
-		context.append("]",1);
-	}
-}
-
-static void format_object(const ijson2::Value::map_type &o, Context &context, int level) {
-	if(o.empty()) {
-		context.append("{}",2);
-	} else {
-		context.append("{",1);
-		bool first=true;
-		for(const auto &e : o) {
-			if(!first)
-				context.append(",",1);
-			if(level>=0) context.append("\n",1);
-			append_indent(context,level>=0?level+1:level);
-			format_string(e.first,context);
-			context.append(":",1);
-			format(e.second,context,level>=0?level+1:level);
-			first = false;
-		}
-		if(level>=0) context.append("\n",1);
-		append_indent(context,level);
-		context.append("}",1);
+static size_t value_size(const ijson2::Value &v, int level, ijson2::nonfinite_policy_t nonfinite_policy) {
+	int inner_level = level>=0 ? level+1 : level;
+	//newline and indentation before each element and before the closing bracket
+	size_t element_prefix = level>=0 ? 1+indent_size(inner_level) : 0;
+	size_t closing_prefix = level>=0 ? 1+indent_size(level) : 0;
+	if(level<0) {
+		if(const std::string *m = v.memoized_compact(nonfinite_policy))
+			return m->size();
 	}
-}
-
-
-static void format(const ijson2::Value &v, Context &context, int level) {
 	switch(v.value_type) {
-		case ijson2::value_type_t::object:
-			format_object(v.u.object_members,context,level);
-			break;
-		case ijson2::value_type_t::array:
-			format_array(v.u.array_elements,context,level);
-			break;
+		case ijson2::value_type_t::object: {
+			const ijson2::Value::map_type &o = v.object();
+			if(o.empty())
+				return 2;
+			size_t size = 2 + (o.size()-1) + o.size()*(element_prefix+1) + closing_prefix;
+			for(const auto &e : o)
+				size += string_size(e.first) + value_size(e.second,inner_level,nonfinite_policy);
+			return size;
+		}
+		case ijson2::value_type_t::array: {
+			const ijson2::Value::array_type &a = v.array();
+			if(a.empty())
+				return 2;
+			size_t size = 2 + (a.size()-1) + a.size()*element_prefix + closing_prefix;
+			for(const auto &e : a)
+				size += value_size(e,inner_level,nonfinite_policy);
+			return size;
+		}
 		case ijson2::value_type_t::string:
-			format_string(v.u.string_value,context);
-			break;
+			return string_size(v.string());
 		case ijson2::value_type_t::boolean:
-			if(v.u.bool_value)
-				context.append("true",4);
-			else
-				context.append("false",5);
-			break;
+			return v.u.bool_value ? 4 : 5;
 		case ijson2::value_type_t::number_double:
-			format_double(v.u.number_doublevalue,context);
-			break;
+			return double_size(v.u.number_doublevalue,nonfinite_policy);
 		case ijson2::value_type_t::number_int64:
-			format_int64(v.u.number_int64value,context);
-			break;
+			return int64_size(v.u.number_int64value);
 		case ijson2::value_type_t::null:
-			context.append("null",4);
-			break;
+			return 4;
+		case ijson2::value_type_t::raw_json:
+			return v.raw_json().size();
 	}
+	return 0;
 }
 
 
-void ijson2::format(const Value &v, ijson2::append_fn_t append_pfn, void *append_context, bool pretty) {
-	Context context(append_pfn,append_context);
-	::format(v,context, pretty?0:-1);
-	if(pretty) context.append("\n",1);
-	context.flush();
+size_t ijson2::formatted_size(const Value &v, bool pretty, nonfinite_policy_t nonfinite_policy) {
+	return value_size(v,pretty?0:-1,nonfinite_policy) + (pretty?1:0);
 }
 
 
-size_t ijson2::format(const Value &v, char *dst, size_t dstsize, bool pretty) {
-	struct context_t {
-		char *dst;
-		size_t dstsize;
-		size_t bytes;
-	} context{dst,dstsize,0};
-	append_fn_t append = [](const char *src, size_t srcsize, void *append_context_) {
-		context_t *append_context = reinterpret_cast<context_t*>(append_context_);
-		if(append_context->bytes+srcsize > append_context->dstsize)
-			throw insufficient_room();
-		memcpy(append_context->dst+append_context->bytes, src, srcsize);
-		append_context->bytes += srcsize;
-	};
-	format(v,append,&context,pretty);
-	return context.bytes;
+std::string ijson2::format_to_string(const Value &v, bool pretty, nonfinite_policy_t nonfinite_policy) {
+	std::string s(formatted_size(v,pretty,nonfinite_policy),'\0');
+	if(!s.empty()) {
+		UncheckedBufferSink sink(&s[0]);
+		format_to(sink,v,pretty,nonfinite_policy);
+	}
+	return s;
+}
+
+
+template<class N>
+static void memoize(const N *n, const ijson2::Value &v, ijson2::nonfinite_policy_t nonfinite_policy) {
+	//unshared nodes may be modified through a reference obtained earlier
+	if(!n || !n->shared || n->memoized_compact.load(std::memory_order_acquire))
+		return;
+	ijson2::memoized_text *text = new ijson2::memoized_text{ijson2::format_to_string(v,false,nonfinite_policy),nonfinite_policy};
+	ijson2::memoized_text *expected = nullptr;
+	//concurrent callers may race; the first one wins
+	if(!n->memoized_compact.compare_exchange_strong(expected,text,std::memory_order_acq_rel))
+		delete text;
+}
+
+void ijson2::memoize_compact(const Value &v, nonfinite_policy_t nonfinite_policy) {
+	if(v.value_type==value_type_t::object)
+		memoize(v.u.object_members,v,nonfinite_policy);
+	else if(v.value_type==value_type_t::array)
+		memoize(v.u.array_elements,v,nonfinite_policy);
 }
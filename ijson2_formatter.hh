@@ -2,15 +2,46 @@
 #define IJSON2_FORMATTER_HH_
 #include "ijson2.hh"
 #include <stdexcept>
+#include <string>
 
 namespace ijson2 {
 
 
 typedef void (*append_fn_t)(const char *src, size_t srcsize, void *context);
 
-void format(const Value &v, append_fn_t pfn, void *append_context, bool pretty=false);
+void format(const Value &v, append_fn_t pfn, void *append_context, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
 
-size_t format(const Value &v, char *dst, size_t dstsize, bool pretty=false);
+size_t format(const Value &v, char *dst, size_t dstsize, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
+
+//Errors reported by try_format(). They correspond to the exceptions of the same name
+enum class format_errc : uint8_t {
+	ok,
+	insufficient_room,
+	nonfinite_number
+};
+
+struct format_result {
+	format_errc error;
+	size_t size;  //bytes written, or the room needed when error is insufficient_room
+	explicit operator bool() const { return error==format_errc::ok; }
+};
+
+//Like format() into a buffer but errors are reported in the result instead of
+//by an exception. format() is a wrapper around this.
+format_result try_format(const Value &v, char *dst, size_t dstsize, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error) noexcept;
+
+//The exact number of bytes format() produces for the value
+size_t formatted_size(const Value &v, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
+
+//Format into a string allocated once with the exact size
+std::string format_to_string(const Value &v, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
+
+//Cache the compact text of a shared array or object (see Value::share()) in
+//the value, so formatting it compactly with the same nonfinite policy (also as
+//part of a larger tree) just copies the cached text. Shared values are
+//immutable, so the text can't go stale: modifying one unshares or clones it
+//without the cache. Unshared and other values are ignored.
+void memoize_compact(const Value &v, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
 
 
 class formatter_error : public std::runtime_error {
@@ -23,6 +54,16 @@ public:
 	insufficient_room() : formatter_error("Insufficient room in output buffer") {}
 };
 
+class nonfinite_number : public formatter_error {
+public:
+	nonfinite_number() : formatter_error("NaN or infinity cannot be represented in JSON") {}
+};
+
+class invalid_structure : public formatter_error {
+public:
+	explicit invalid_structure(const char *what_arg) : formatter_error(what_arg) {}
+};
+
 class invalid_utf8 : public formatter_error {
 public:
 	invalid_utf8() : formatter_error("Invalid or truncated UTF-8 sequence found") {}
@@ -1,6 +1,7 @@
 #include "ijson2_formatter.hh"
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 #include <string>
 
 
@@ -63,6 +64,18 @@ int main() {
 		ijson2::format(v, append,&s);
 		assert(s=="-123456");
 	}
+	{
+		ijson2::Value v{INT64_MIN};
+		s.clear();
+		ijson2::format(v, append,&s);
+		assert(s=="-9223372036854775808");
+	}
+	{
+		ijson2::Value v{INT64_MAX};
+		s.clear();
+		ijson2::format(v, append,&s);
+		assert(s=="9223372036854775807");
+	}
 	
 	printf("formatting double\n");
 	{
@@ -83,6 +96,46 @@ int main() {
 		ijson2::format(v, append,&s);
 		assert(s=="-42.5");
 	}
+	{
+		//shortest representation which reads back as the same double
+		static const struct {
+			double d;
+			const char *expected;
+		} tests[] = {
+			{0.1, "0.1"},
+			{0.3, "0.3"},
+			{1.0/3, "0.3333333333333333"},
+			{-2.5e-7, "-0.00000025"},
+			{1.5e-17, "1.5e-17"},
+			{1e16+2, "10000000000000002"},
+			{1e300, "1e300"},
+			{1.7976931348623157e308, "1.7976931348623157e308"},
+			{2.2250738585072014e-308, "2.2250738585072014e-308"},
+			{7.120236347223045e-307, "7.120236347223045e-307"}, //power of two, so the rounding interval is asymmetric
+			{9.5e-306, "9.5e-306"},
+		};
+		for(const auto &t : tests) {
+			s.clear();
+			ijson2::format(ijson2::Value(t.d), append,&s);
+			assert(s==t.expected);
+		}
+	}
+	{
+		//NaN and infinity
+		ijson2::Value v{ijson2::Value::array_type{ijson2::Value(NAN),ijson2::Value(INFINITY),ijson2::Value(-INFINITY)}};
+		s.clear();
+		try {
+			ijson2::format(v, append,&s);
+			assert(false);
+		} catch(const ijson2::nonfinite_number &) {
+		}
+		s.clear();
+		ijson2::format(v, append,&s, false, ijson2::nonfinite_policy_t::null);
+		assert(s=="[null,null,null]");
+		s.clear();
+		ijson2::format(v, append,&s, false, ijson2::nonfinite_policy_t::string);
+		assert(s=="[\"NaN\",\"Infinity\",\"-Infinity\"]");
+	}
 	
 	printf("formatting strings\n");
 	{
@@ -97,6 +150,43 @@ int main() {
 		ijson2::format(v, append,&s);
 		assert(s=="\"fo\\no\"");
 	}
+	{
+		//every character at every position of strings long enough for the vectorized escaping
+		auto reference = [](const std::string &str) {
+			std::string r = "\"";
+			for(char c : str) {
+				switch(c) {
+					case '"': r += "\\\""; break;
+					case '\\': r += "\\\\"; break;
+					case '\b': r += "\\b"; break;
+					case '\f': r += "\\f"; break;
+					case '\n': r += "\\n"; break;
+					case '\r': r += "\\r"; break;
+					case '\t': r += "\\t"; break;
+					default:
+						if(static_cast<uint8_t>(c)<32) {
+							char buf[8];
+							sprintf(buf,"\\u%04X",static_cast<uint8_t>(c));
+							r += buf;
+						} else
+							r += c;
+				}
+			}
+			return r+"\"";
+		};
+		for(unsigned c=0; c<256; c++) {
+			for(size_t len : {1,15,16,17,31,32,33,70}) {
+				for(size_t pos=0; pos<len; pos+=(len>20?7:1)) {
+					std::string str(len,'a');
+					str[pos] = static_cast<char>(c);
+					ijson2::Value v(ijson2::string_view(str.data(),str.size()));
+					s.clear();
+					ijson2::format(v, append,&s);
+					assert(s==reference(str));
+				}
+			}
+		}
+	}
 	
 	printf("formatting arrays\n");
 	{
@@ -107,8 +197,8 @@ int main() {
 	}
 	{
 		ijson2::Value v{ijson2::Value::array_type{}};
-		v.u.array_elements.push_back("abc");
-		v.u.array_elements.push_back(17);
+		v.array().push_back("abc");
+		v.array().push_back(17);
 		s.clear();
 		ijson2::format(v, append,&s);
 		assert(s=="[\"abc\",17]");
@@ -123,11 +213,175 @@ int main() {
 	}
 	{
 		ijson2::Value v{ijson2::Value::map_type{}};
-		v.u.object_members["foo"] = "abc";
-		v.u.object_members["boo"] = 17;
+		v.object()["foo"] = "abc";
+		v.object()["boo"] = 17;
 		s.clear();
 		ijson2::format(v, append,&s);
 		assert(s=="{\"foo\":\"abc\",\"boo\":17}" || s=="{\"boo\":17,\"foo\":\"abc\"}");
 	}
+	{
+		//member names around the length copied in one go, with and without escaping
+		for(size_t l=59; l<=63; l++) {
+			for(int escaped=0; escaped<2; escaped++) {
+				std::string name(l,'n');
+				if(escaped) name[l-1] = '\n';
+				ijson2::Value v{ijson2::Value::map_type{}};
+				v.object()[ijson2::string_view(name.data(),name.size())] = 1;
+				std::string expected = "{\"" + name.substr(0,l-escaped) + (escaped?"\\n":"") + "\":1}";
+				assert(ijson2::format_to_string(v)==expected);
+				s.clear();
+				ijson2::format(v, append,&s);
+				assert(s==expected);
+			}
+		}
+	}
+	
+	printf("measuring\n");
+	{
+		ijson2::Value v{ijson2::Value::map_type{}};
+		v.object()["a\tb"] = ijson2::Value::array_type{ijson2::Value(1),ijson2::Value(-2.5e-30),ijson2::Value("x\"\x01y"),ijson2::Value(true),ijson2::Value()};
+		v.object()["c"] = ijson2::Value::map_type{};
+		v.object()["c"].object()["d"] = ijson2::Value::array_type{ijson2::Value::array_type{}};
+		v.object()["e"] = 0.1;
+		for(bool pretty : {false,true}) {
+			s.clear();
+			ijson2::format(v, append,&s, pretty);
+			assert(ijson2::formatted_size(v,pretty)==s.size());
+			assert(ijson2::format_to_string(v,pretty)==s);
+		}
+		assert(ijson2::format_to_string(ijson2::Value())=="null");
+		
+		//deep nesting, indented with more than 8 tabs
+		ijson2::Value deep{17};
+		for(int i=0; i<12; i++)
+			deep = ijson2::Value(ijson2::Value::array_type{std::move(deep)});
+		s = ijson2::format_to_string(deep,true);
+		assert(s.size()==ijson2::formatted_size(deep,true));
+		assert(s.find("\n\t\t\t\t\t\t\t\t\t\t\t\t17\n")!=std::string::npos);
+		assert(s.find("\n\t\t\t\t\t\t\t\t\t\t\t]\n")!=std::string::npos);
+		assert(ijson2::format_to_string(ijson2::Value(NAN),false,ijson2::nonfinite_policy_t::string)=="\"NaN\"");
+		try {
+			ijson2::formatted_size(ijson2::Value(NAN));
+			assert(false);
+		} catch(const ijson2::nonfinite_number &) {
+		}
+	}
+	
+	printf("formatting raw JSON\n");
+	{
+		ijson2::Value v{ijson2::Value::map_type{}};
+		v.object()["payload"] = ijson2::Value::from_raw_json("{\"a\" : [1, 2]}");
+		v.object()["x"] = ijson2::Value::array_type{ijson2::Value::from_raw_json("true")};
+		assert(ijson2::format_to_string(v)=="{\"payload\":{\"a\" : [1, 2]},\"x\":[true]}");
+		assert(ijson2::format_to_string(v,true)=="{\n\t\"payload\":{\"a\" : [1, 2]},\n\t\"x\":[\n\t\ttrue\n\t]\n}\n");
+		for(bool pretty : {false,true})
+			assert(ijson2::formatted_size(v,pretty)==ijson2::format_to_string(v,pretty).size());
+	}
+	
+	printf("memoizing\n");
+	{
+		std::string s;
+		ijson2::Value v{ijson2::Value::map_type{}};
+		v.object()["static"] = ijson2::Value::array_type{ijson2::Value(1),ijson2::Value("x\ty"),ijson2::Value::map_type{}};
+		v.object()["static"].array()[2].object()["z"] = 0.5;
+		v.object()["dynamic"] = 7;
+		std::string expected = ijson2::format_to_string(v);
+		std::string expected_pretty = ijson2::format_to_string(v,true);
+		const ijson2::Value &cv = v;
+		
+		//unshared values may be modified through a reference obtained earlier, so they aren't memoized
+		ijson2::Value::array_type &held = v.object()["static"].array();
+		ijson2::memoize_compact(cv.at("static"));
+		assert(!cv.at("static").memoized_compact());
+		held.push_back(ijson2::Value(2));
+		assert(ijson2::format_to_string(v)=="{\"dynamic\":7,\"static\":[1,\"x\\ty\",{\"z\":0.5},2]}");
+		held.pop_back();
+		
+		v.object()["static"].share();
+		ijson2::memoize_compact(cv.at("static"));
+		ijson2::memoize_compact(cv.at("static").array()[2]);
+		ijson2::memoize_compact(cv.at("dynamic")); //ignored
+		assert(cv.at("static").memoized_compact());
+		assert(*cv.at("static").memoized_compact()=="[1,\"x\\ty\",{\"z\":0.5}]");
+		assert(!cv.at("dynamic").memoized_compact());
+		assert(ijson2::format_to_string(v)==expected);
+		assert(ijson2::formatted_size(v)==expected.size());
+		assert(ijson2::format_to_string(v,true)==expected_pretty);
+		ijson2::format(v, append,&s);
+		assert(s==expected);
+		
+		//modifying a nested value unshares the path and drops the cache on it. Other elements stay shared
+		v.object()["static"].array()[1] = "changed";
+		assert(!cv.at("static").memoized_compact());
+		assert(cv.at("static").array()[2].memoized_compact());
+		assert(ijson2::format_to_string(v)=="{\"dynamic\":7,\"static\":[1,\"changed\",{\"z\":0.5}]}");
+		
+		//copies of shared trees share the cache
+		v.share();
+		ijson2::memoize_compact(v);
+		ijson2::Value copy(v);
+		assert(copy.memoized_compact()==v.memoized_compact());
+		copy.object()["dynamic"] = 8;
+		assert(!copy.memoized_compact());
+		assert(v.memoized_compact());
+		assert(ijson2::format_to_string(copy)=="{\"dynamic\":8,\"static\":[1,\"changed\",{\"z\":0.5}]}");
+	}
+	{
+		//the cached text is only used with the nonfinite policy it was formatted with
+		ijson2::Value v{ijson2::Value::array_type{ijson2::Value(1),ijson2::Value(INFINITY)}};
+		v.share();
+		ijson2::memoize_compact(v,ijson2::nonfinite_policy_t::null);
+		assert(v.memoized_compact(ijson2::nonfinite_policy_t::null));
+		assert(!v.memoized_compact(ijson2::nonfinite_policy_t::string));
+		assert(ijson2::format_to_string(v,false,ijson2::nonfinite_policy_t::null)=="[1,null]");
+		assert(ijson2::format_to_string(v,false,ijson2::nonfinite_policy_t::string)=="[1,\"Infinity\"]");
+		assert(ijson2::formatted_size(v,false,ijson2::nonfinite_policy_t::string)==14);
+		bool thrown = false;
+		try {
+			ijson2::format_to_string(v);
+		} catch(const ijson2::nonfinite_number &) {
+			thrown = true;
+		}
+		assert(thrown);
+	}
+	
+	printf("error codes instead of exceptions\n");
+	{
+		ijson2::Value v{ijson2::Value::array_type{ijson2::Value(1),ijson2::Value("abc"),ijson2::Value(0.5)}};
+		const std::string expected = "[1,\"abc\",0.5]";
+		char buf[64];
+		ijson2::format_result r = ijson2::try_format(v,buf,sizeof(buf));
+		assert(r);
+		assert(r.size==expected.size());
+		assert(std::string(buf,r.size)==expected);
+		//exactly enough room, and one byte short at every position
+		r = ijson2::try_format(v,buf,expected.size());
+		assert(r && std::string(buf,r.size)==expected);
+		for(size_t room=0; room<expected.size(); room++) {
+			r = ijson2::try_format(v,buf,room);
+			assert(r.error==ijson2::format_errc::insufficient_room);
+			assert(r.size==expected.size());
+			try {
+				ijson2::format(v,buf,room);
+				assert(false);
+			} catch(const ijson2::insufficient_room &) {
+			}
+		}
+		r = ijson2::try_format(v,buf,sizeof(buf),true);
+		assert(r && std::string(buf,r.size)==ijson2::format_to_string(v,true));
+		
+		v.array().push_back(NAN);
+		r = ijson2::try_format(v,buf,sizeof(buf));
+		assert(r.error==ijson2::format_errc::nonfinite_number);
+		r = ijson2::try_format(v,buf,2);
+		assert(r.error==ijson2::format_errc::nonfinite_number);
+		r = ijson2::try_format(v,buf,sizeof(buf),false,ijson2::nonfinite_policy_t::null);
+		assert(r && std::string(buf,r.size)=="[1,\"abc\",0.5,null]");
+		try {
+			ijson2::format(v,buf,sizeof(buf));
+			assert(false);
+		} catch(const ijson2::nonfinite_number &) {
+		}
+	}
 	return 0;
 }
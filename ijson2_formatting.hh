@@ -0,0 +1,90 @@
+#ifndef IJSON2_FORMATTING_HH_
+#define IJSON2_FORMATTING_HH_
+#include "ijson2_string_view.hh"
+#include "ijson2_formatter.hh"
+#include <stddef.h>
+#include <stdint.h>
+
+//Building blocks shared by the formatters and sinks. This is the sink
+//customisation API: a sink can overload append_unescaped() below and
+//nonfinite_error() in ijson2_sink.hh in its own namespace, where they are
+//found by argument-dependent lookup. The rest may change between versions.
+
+namespace ijson2 {
+namespace formatting {
+
+//Number of leading characters in s[0..l) which can be output as they are
+size_t unescaped_prefix_length(const char *s, size_t l);
+
+//The escape sequences for characters which must be escaped. length is 0 for those that don't.
+struct escape_sequence_t {
+	uint8_t length;
+	char chars[7];
+};
+extern const escape_sequence_t escape_sequence[256];
+
+
+//Append characters which need no escaping. Sinks which can refer to the
+//characters in place instead of copying them overload this (see IovecSink).
+//Call it unqualified after "using formatting::append_unescaped;".
+template<class Sink>
+inline void append_unescaped(Sink &sink, const char *s, size_t l) {
+	sink.append(s,l);
+}
+
+
+//Append the string contents (without quotes) escaped. Runs of characters not
+//needing escaping are appended in one go.
+template<class Sink>
+void append_escaped(const string_view &sv, Sink &sink) {
+	const char *s = sv.data();
+	size_t l = sv.size();
+	while(l>0) {
+		size_t clean = unescaped_prefix_length(s,l);
+		if(clean>0) {
+			append_unescaped(sink,s,clean);
+			s += clean;
+			l -= clean;
+			if(l==0)
+				break;
+		}
+		const escape_sequence_t &e = escape_sequence[static_cast<uint8_t>(*s)];
+		sink.append(e.chars,e.length);
+		s++;
+		l--;
+	}
+}
+
+
+//Longest possible output of format_uint64()/format_int64()
+static const size_t max_integer_length = 20;
+
+//Write the integer as text at dst and return the end. No NUL-termination.
+char *format_uint64(uint64_t u, char *dst);
+inline char *format_int64(int64_t i, char *dst) {
+	if(i<0) {
+		*dst++ = '-';
+		return format_uint64(-static_cast<uint64_t>(i),dst);
+	} else
+		return format_uint64(static_cast<uint64_t>(i),dst);
+}
+
+//Longest possible output of format_double()
+static const size_t max_double_length = 40;
+
+//Length of what format_double() writes
+size_t double_length(double d);
+
+//Write the shortest text which reads back as the same double. d must be normal (not zero, subnormal, infinite or NaN)
+char *format_double(double d, char *dst);
+
+//Longest possible output of format_nonfinite()
+static const size_t max_nonfinite_length = 11;
+
+//Write NaN or infinity according to the policy and return the end
+char *format_nonfinite(double d, nonfinite_policy_t policy, char *dst);
+
+} //namespace formatting
+} //namespace ijson2
+
+#endif
@@ -0,0 +1,66 @@
+//Command-line tool for building and querying sidecar indexes of JSON files
+#include "ijson2_sidecar_index.hh"
+#include "ijson2_parser.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace ijson2;
+
+
+static void usage() {
+	fprintf(stderr,"usage: ijson2_index build <json-file> <index-file> [key-path...]\n");
+	fprintf(stderr,"       ijson2_index count <json-file> <index-file>\n");
+	fprintf(stderr,"       ijson2_index get <json-file> <index-file> <record-number> [key-path]\n");
+	fprintf(stderr,"       ijson2_index find <json-file> <index-file> <key-path> <json-value>\n");
+	exit(2);
+}
+
+
+int main(int argc, char **argv) {
+	if(argc<4)
+		usage();
+	const char *command = argv[1];
+	const char *json_filename = argv[2];
+	const char *index_filename = argv[3];
+	try {
+		if(strcmp(command,"build")==0) {
+			SidecarIndex::build(json_filename,index_filename,std::vector<std::string>(argv+4,argv+argc));
+		} else if(strcmp(command,"count")==0) {
+			SidecarIndex index(json_filename,index_filename);
+			printf("%zu\n",index.records());
+		} else if(strcmp(command,"get")==0) {
+			if(argc!=5 && argc!=6)
+				usage();
+			SidecarIndex index(json_filename,index_filename);
+			std::string text;
+			size_t record = strtoul(argv[4],nullptr,10);
+			if(argc==6) {
+				if(!index.read_value(record,argv[5],&text))
+					return 1;
+			} else
+				index.read_record(record,&text);
+			printf("%s\n",text.c_str());
+		} else if(strcmp(command,"find")==0) {
+			if(argc!=6)
+				usage();
+			SidecarIndex index(json_filename,index_filename);
+			Parser parser;
+			parser.parse(argv[5],strlen(argv[5]));
+			std::string text;
+			auto found = index.find(argv[4],parser.value());
+			for(size_t record : found) {
+				index.read_record(record,&text);
+				printf("%s\n",text.c_str());
+			}
+			if(found.empty())
+				return 1;
+		} else
+			usage();
+	} catch(const std::exception &ex) {
+		fprintf(stderr,"ijson2_index: %s\n",ex.what());
+		return 2;
+	}
+	return 0;
+}
@@ -19,6 +19,20 @@ void *ijson2::MemoryArena::alloc(size_t bytes, size_t alignment) {
 }
 
 
+ijson2::MemoryArena& ijson2::MemoryArena::operator=(MemoryArena &&ma) noexcept {
+	if(this!=&ma) {
+		clear();
+		chunks.swap(ma.chunks);
+		lastest_chunk_size = ma.lastest_chunk_size;
+		lastest_chunk_used = ma.lastest_chunk_used;
+		chunk_size = ma.chunk_size;
+		ma.lastest_chunk_size = 0;
+		ma.lastest_chunk_used = 0;
+	}
+	return *this;
+}
+
+
 void ijson2::MemoryArena::clear() {
 	for(auto e : chunks)
 		delete[] e;
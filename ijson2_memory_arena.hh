@@ -18,6 +18,17 @@ public:
 	    lastest_chunk_used(0),
 	    chunk_size(chunk_size_)
 	  {}
+	MemoryArena(MemoryArena &&ma) noexcept
+	  : chunks(std::move(ma.chunks)),
+	    lastest_chunk_size(ma.lastest_chunk_size),
+	    lastest_chunk_used(ma.lastest_chunk_used),
+	    chunk_size(ma.chunk_size)
+	{
+		ma.chunks.clear();
+		ma.lastest_chunk_size = 0;
+		ma.lastest_chunk_used = 0;
+	}
+	MemoryArena& operator=(MemoryArena &&ma) noexcept;
 	~MemoryArena() { clear(); }
 	
 	void *alloc(size_t bytes, size_t alignment);
@@ -27,7 +38,7 @@ private:
 	std::vector<char *> chunks;
 	size_t lastest_chunk_size;
 	size_t lastest_chunk_used;
-	const size_t chunk_size;
+	size_t chunk_size;
 };
 
 
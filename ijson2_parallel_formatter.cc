@@ -0,0 +1,259 @@
+#include "ijson2_parallel_formatter.hh"
+#include "ijson2_sink.hh"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace ijson2;
+
+//Containers with at least this many elements are split into ranges
+static const size_t split_elements = 1024;
+//Containers with fewer elements than this are looked into for big containers, down to max_descend_depth
+static const size_t descend_elements = 16;
+static const int max_descend_depth = 3;
+
+
+//A piece of the output. Text pieces are produced while planning; the others are formatted by the workers
+struct Piece {
+	enum class kind_t { text, value, array_elements, object_members };
+	kind_t kind;
+	const Value *v;
+	size_t begin, end;                             //array elements
+	Value::map_type::const_iterator first, last;   //object members
+	int level;                                     //level of v
+	std::string output;
+};
+
+
+class Planner {
+	std::vector<Piece> &pieces;
+	size_t ranges;
+	nonfinite_policy_t nonfinite_policy;
+	
+	std::string &text() {
+		if(pieces.empty() || pieces.back().kind!=Piece::kind_t::text)
+			pieces.push_back(Piece{Piece::kind_t::text,nullptr,0,0,{},{},0,std::string()});
+		return pieces.back().output;
+	}
+	void append_text(const char *s, size_t l) { text().append(s,l); }
+	//separator and indentation before element i of a container at the level
+	void separator(size_t i, int level) {
+		if(i>0)
+			append_text(",",1);
+		if(level>=0) {
+			append_text("\n",1);
+			text().append(static_cast<size_t>(level+1),'\t');
+		}
+	}
+	void close(int level, char c) {
+		if(level>=0) {
+			append_text("\n",1);
+			text().append(static_cast<size_t>(level),'\t');
+		}
+		append_text(&c,1);
+	}
+	
+public:
+	Planner(std::vector<Piece> &pieces_, unsigned threads, nonfinite_policy_t nonfinite_policy_)
+	  : pieces(pieces_),
+	    ranges(threads*4),
+	    nonfinite_policy(nonfinite_policy_)
+	  {}
+	
+	void plan(const Value &v, int level, int depth);
+};
+
+
+void Planner::plan(const Value &v, int level, int depth) {
+	int inner_level = level>=0 ? level+1 : level;
+	if(level<0 && v.memoized_compact(nonfinite_policy)) {
+		pieces.push_back(Piece{Piece::kind_t::value,&v,0,0,{},{},level,std::string()});
+		return;
+	}
+	if(v.value_type==value_type_t::array && !v.array().empty()) {
+		const Value::array_type &a = v.array();
+		if(a.size()>=split_elements) {
+			append_text("[",1);
+			size_t step = (a.size()+ranges-1)/ranges;
+			for(size_t b=0; b<a.size(); b+=step)
+				pieces.push_back(Piece{Piece::kind_t::array_elements,&v,b,std::min(b+step,a.size()),{},{},level,std::string()});
+			close(level,']');
+			return;
+		}
+		if(a.size()<descend_elements && depth<max_descend_depth) {
+			append_text("[",1);
+			for(size_t i=0; i<a.size(); i++) {
+				separator(i,level);
+				plan(a[i],inner_level,depth+1);
+			}
+			close(level,']');
+			return;
+		}
+	} else if(v.value_type==value_type_t::object && !v.object().empty()) {
+		const Value::map_type &o = v.object();
+		if(o.size()>=split_elements) {
+			append_text("{",1);
+			size_t step = (o.size()+ranges-1)/ranges;
+			auto it = o.begin();
+			for(size_t b=0; b<o.size(); b+=step) {
+				auto first = it;
+				std::advance(it,std::min(step,o.size()-b));
+				pieces.push_back(Piece{Piece::kind_t::object_members,&v,b,0,first,it,level,std::string()});
+			}
+			close(level,'}');
+			return;
+		}
+		if(o.size()<descend_elements && depth<max_descend_depth) {
+			append_text("{",1);
+			size_t i=0;
+			for(const auto &e : o) {
+				separator(i++,level);
+				StringSink sink(text());
+				formatting::append_string(e.first,sink);
+				sink.append(":",1);
+				sink.flush();
+				plan(e.second,inner_level,depth+1);
+			}
+			close(level,'}');
+			return;
+		}
+	}
+	pieces.push_back(Piece{Piece::kind_t::value,&v,0,0,{},{},level,std::string()});
+}
+
+
+static void format_piece(Piece &p, nonfinite_policy_t nonfinite_policy) {
+	StringSink sink(p.output);
+	int inner_level = p.level>=0 ? p.level+1 : p.level;
+	switch(p.kind) {
+		case Piece::kind_t::text:
+			return;
+		case Piece::kind_t::value:
+			formatting::format_value(*p.v,sink,p.level,nonfinite_policy);
+			break;
+		case Piece::kind_t::array_elements: {
+			const Value::array_type &a = p.v->array();
+			for(size_t i=p.begin; i<p.end; i++) {
+				if(i>0)
+					sink.append(",",1);
+				if(p.level>=0) sink.append("\n",1);
+				formatting::append_indent(sink,inner_level);
+				formatting::format_value(a[i],sink,inner_level,nonfinite_policy);
+			}
+			break;
+		}
+		case Piece::kind_t::object_members: {
+			bool first = p.begin==0;
+			for(auto it=p.first; it!=p.last; ++it) {
+				if(!first)
+					sink.append(",",1);
+				if(p.level>=0) sink.append("\n",1);
+				formatting::append_indent(sink,inner_level);
+				formatting::append_string(it->first,sink);
+				sink.append(":",1);
+				formatting::format_value(it->second,sink,inner_level,nonfinite_policy);
+				first = false;
+			}
+			break;
+		}
+	}
+	sink.flush();
+}
+
+
+//Format all pieces using the calling thread plus threads-1 more
+static void format_pieces(std::vector<Piece> &pieces, nonfinite_policy_t nonfinite_policy, unsigned threads) {
+	std::atomic<size_t> next(0);
+	std::mutex mtx;
+	std::exception_ptr error;
+	auto worker = [&]() {
+		for(;;) {
+			size_t i = next++;
+			if(i>=pieces.size())
+				return;
+			try {
+				format_piece(pieces[i],nonfinite_policy);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(mtx);
+				if(!error)
+					error = std::current_exception();
+				next = pieces.size();
+				return;
+			}
+		}
+	};
+	
+	size_t work_pieces = 0;
+	for(const auto &p : pieces)
+		if(p.kind!=Piece::kind_t::text)
+			work_pieces++;
+	if(threads>work_pieces)
+		threads = static_cast<unsigned>(work_pieces);
+	
+	std::vector<std::thread> pool;
+	if(threads>1)
+		pool.reserve(threads-1);
+	for(unsigned t=1; t<threads; t++) {
+		try {
+			pool.emplace_back(worker);
+		} catch(const std::system_error &) {
+			//out of threads. The ones started and this one do all the pieces
+			break;
+		}
+	}
+	worker();
+	for(auto &t : pool)
+		t.join();
+	if(error)
+		std::rethrow_exception(error);
+}
+
+
+static std::vector<Piece> format_into_pieces(const Value &v, bool pretty, nonfinite_policy_t nonfinite_policy, unsigned threads) {
+	if(threads==0)
+		threads = std::thread::hardware_concurrency();
+	if(threads==0)
+		threads = 1;
+	std::vector<Piece> pieces;
+	if(threads>1) {
+		Planner planner(pieces,threads,nonfinite_policy);
+		planner.plan(v,pretty?0:-1,0);
+	} else
+		pieces.push_back(Piece{Piece::kind_t::value,&v,0,0,{},{},pretty?0:-1,std::string()});
+	if(pretty)
+		pieces.push_back(Piece{Piece::kind_t::text,nullptr,0,0,{},{},0,std::string("\n")});
+	format_pieces(pieces,nonfinite_policy,threads);
+	return pieces;
+}
+
+} //anonymous namespace
+
+
+void ijson2::format_parallel(const Value &v, append_fn_t append_pfn, void *append_context, bool pretty, nonfinite_policy_t nonfinite_policy, unsigned threads) {
+	std::vector<Piece> pieces = format_into_pieces(v,pretty,nonfinite_policy,threads);
+	for(auto &p : pieces) {
+		if(!p.output.empty())
+			append_pfn(p.output.data(),p.output.size(),append_context);
+		std::string().swap(p.output);
+	}
+}
+
+
+std::string ijson2::format_parallel_to_string(const Value &v, bool pretty, nonfinite_policy_t nonfinite_policy, unsigned threads) {
+	std::vector<Piece> pieces = format_into_pieces(v,pretty,nonfinite_policy,threads);
+	size_t total = 0;
+	for(const auto &p : pieces)
+		total += p.output.size();
+	std::string result;
+	result.reserve(total);
+	for(auto &p : pieces) {
+		result += p.output;
+		std::string().swap(p.output);
+	}
+	return result;
+}
@@ -0,0 +1,20 @@
+#ifndef IJSON2_PARALLEL_FORMATTER_HH_
+#define IJSON2_PARALLEL_FORMATTER_HH_
+#include "ijson2_formatter.hh"
+#include <string>
+
+//Formatting of large values using several threads. Large arrays and objects
+//are split into ranges of elements which are formatted into separate buffers
+//by a pool of threads, and the buffers are then output in order. The output is
+//identical to format(). It only pays off for big values (eg. export files);
+//small values are formatted by the calling thread alone.
+
+namespace ijson2 {
+
+//threads=0 means std::thread::hardware_concurrency(). The callback is called from the calling thread only.
+void format_parallel(const Value &v, append_fn_t append_pfn, void *append_context, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error, unsigned threads=0);
+std::string format_parallel_to_string(const Value &v, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error, unsigned threads=0);
+
+} //namespace
+
+#endif
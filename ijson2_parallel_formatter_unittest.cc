@@ -0,0 +1,103 @@
+#include "ijson2_parallel_formatter.hh"
+#include "ijson2_parser.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+using namespace ijson2;
+
+
+static void check(const Value &v) {
+	for(bool pretty : {false,true}) {
+		std::string expected = format_to_string(v,pretty);
+		for(unsigned threads : {0U,1U,2U,3U,8U}) {
+			assert(format_parallel_to_string(v,pretty,nonfinite_policy_t::error,threads)==expected);
+			std::string s;
+			format_parallel(v,[](const char *src, size_t srcsize, void *append_context) {
+				reinterpret_cast<std::string*>(append_context)->append(src,srcsize);
+			},&s,pretty,nonfinite_policy_t::error,threads);
+			assert(s==expected);
+		}
+	}
+}
+
+
+static Value make_array(size_t n) {
+	Value a{Value::array_type()};
+	for(size_t i=0; i<n; i++) {
+		switch(i%6) {
+			case 0: a.array().emplace_back(nullptr); break;
+			case 1: a.array().emplace_back("b\"o\no"); break;
+			case 2: a.array().emplace_back(17.42); break;
+			case 3: a.array().emplace_back(static_cast<int64_t>(i)); break;
+			case 4: {
+				Value::map_type o;
+				o["x"] = Value(static_cast<int64_t>(i));
+				a.array().emplace_back(o);
+				break;
+			}
+			case 5: a.array().emplace_back(Value::array_type{}); break;
+		}
+	}
+	return a;
+}
+
+
+int main(void) {
+	printf("Small values\n");
+	{
+		static const char json[] = "{\"a\":[1,-2.5,\"x\\ty\",true,null],\"b\":{\"c\":1e300},\"d\":[],\"e\":{}}";
+		Parser parser;
+		parser.parse(json,sizeof(json)-1);
+		check(parser.value());
+		check(Value());
+		check(Value(Value::array_type{}));
+	}
+	
+	printf("Large arrays\n");
+	{
+		for(size_t n : {1023,1024,1025,5000})
+			check(make_array(n));
+	}
+	
+	printf("Large objects\n");
+	{
+		Value o(Value::map_type{});
+		std::vector<std::string> keys;
+		for(int i=0; i<3000; i++)
+			keys.push_back("key" + std::to_string(i));
+		for(int i=0; i<3000; i++)
+			o.object()[string_view(keys[i].data(),keys[i].size())] = Value(static_cast<int64_t>(i));
+		check(o);
+	}
+	
+	printf("Large containers inside small ones\n");
+	{
+		Value o(Value::map_type{});
+		o.object()["meta"] = Value(true);
+		o.object()["data"] = make_array(4000);
+		Value a{Value::array_type()};
+		a.array().push_back(o);
+		a.array().push_back(make_array(10));
+		a.array().push_back(make_array(2000));
+		check(a);
+	}
+	
+	printf("Errors in worker threads\n");
+	{
+		Value a = make_array(5000);
+		a.array()[4321] = Value(NAN);
+		bool caught=false;
+		try {
+			format_parallel_to_string(a,false,nonfinite_policy_t::error,4);
+		} catch(nonfinite_number &) {
+			caught = true;
+		}
+		assert(caught);
+		assert(format_parallel_to_string(a,true,nonfinite_policy_t::null,4)==format_to_string(a,true,nonfinite_policy_t::null));
+	}
+	
+	return 0;
+}
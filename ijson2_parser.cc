@@ -1,6 +1,7 @@
 #include "ijson2_parser.hh"
 #include <string.h>
 #include <memory>
+#include <new>
 #include <errno.h>
 #include <math.h>
 #include <limits.h>
@@ -74,9 +75,25 @@ static size_t uc_to_utf8(uint32_t uc, char *dst) {
 }
 
 
+//The code point of the 4 hex digits of a \u escape. False if they aren't hex digits
+static bool unicode_escape_value(const char *p, uint32_t *uc) {
+	int v0 = hexdigit_value(p[0]);
+	int v1 = hexdigit_value(p[1]);
+	int v2 = hexdigit_value(p[2]);
+	int v3 = hexdigit_value(p[3]);
+	if(v0<0 || v1<0 || v2<0 || v3<0)
+		return false;
+	*uc = (static_cast<uint32_t>(v0))<<24 |
+	      (static_cast<uint32_t>(v1))<<16 |
+	      (static_cast<uint32_t>(v2))<< 8 |
+	      (static_cast<uint32_t>(v3))     ;
+	return true;
+}
+
+
 const char *ijson2::Parser::parse_string(const char *s, const char *end, string_view *sv) {
 	if(end-s<2)
-		throw unterminated_string(s);
+		return fail(parse_errc::unterminated_string,s);
 	const char *p = s+1;
 	bool any_backslashes = false;
 	while(p<end) {
@@ -85,23 +102,23 @@ const char *ijson2::Parser::parse_string(const char *s, const char *end, string_
 			break;
 #if STRICT_PARSING
 		if((uint8_t)c<32 && !any_backslashes)
-			throw missing_escape(p);
+			return fail(parse_errc::missing_escape,p);
 #endif
 		p++;
 		if(c=='\\') {
 			if(p==end)
-				throw unterminated_string(s);
+				return fail(parse_errc::unterminated_string,s);
 			any_backslashes = true;
 			p++;
 		}
 	}
 	if(p>=end)
-		throw unterminated_string(s);
+		return fail(parse_errc::unterminated_string,s);
 	if(!any_backslashes) {
 		//no backslashes - use string_view directly into source
 		*sv = string_view{s+1, size_t(p-s-1)};
 	} else {
-		char *dst_start = reinterpret_cast<char*>(memory_arena.alloc(end-s-2,1));
+		char *dst_start = reinterpret_cast<char*>(memory_arena.alloc(p-s-1,1));
 		char *dst = dst_start;
 		const char *src = s+1;
 		const char *src_end = p;
@@ -110,13 +127,13 @@ const char *ijson2::Parser::parse_string(const char *s, const char *end, string_
 			if(c!='\\') {
 #if STRICT_PARSING
 				if((uint8_t)c<32)
-					throw missing_escape(src);
+					return fail(parse_errc::missing_escape,src);
 #endif
 				*dst++ = c;
 				src++;
 			} else {
 				if(src+1==src_end)
-					throw invalid_escape(src);
+					return fail(parse_errc::invalid_escape,src);
 				switch(src[1]) {
 					case '"':
 					case '\\':
@@ -146,27 +163,20 @@ const char *ijson2::Parser::parse_string(const char *s, const char *end, string_
 						break;
 					case 'u': {
 						if(src+1+1+4 >= end)
-							throw invalid_escape(src);
-						int v0 = hexdigit_value(src[2]);
-						int v1 = hexdigit_value(src[3]);
-						int v2 = hexdigit_value(src[4]);
-						int v3 = hexdigit_value(src[5]);
-						if(v0<0 || v1<0 || v2<0 || v3<0)
-							throw invalid_escape(src);
-						uint32_t uc = (static_cast<uint32_t>(v0))<<24 |
-						              (static_cast<uint32_t>(v1))<<16 |
-						              (static_cast<uint32_t>(v2))<< 8 |
-						              (static_cast<uint32_t>(v3))     ;
+							return fail(parse_errc::invalid_escape,src);
+						uint32_t uc;
+						if(!unicode_escape_value(src+2,&uc))
+							return fail(parse_errc::invalid_escape,src);
 						//todo: handle surrogate pairs
 						size_t utf8_len = uc_to_utf8(uc,dst);
 						if(utf8_len==0)
-							throw invalid_escape(src);
+							return fail(parse_errc::invalid_escape,src);
 						dst += utf8_len;
 						src += 6;
 						break;
 					}
 					default:
-						throw invalid_escape(src);
+						return fail(parse_errc::invalid_escape,src);
 				}
 			}
 		}
@@ -178,9 +188,9 @@ const char *ijson2::Parser::parse_string(const char *s, const char *end, string_
 
 const char *ijson2::Parser::parse_null_value(const char *s, const char *end, Value *value) {
 	if(end-s<4 || memcmp(s,"null",4)!=0)
-		throw junk(s);
+		return fail(parse_errc::junk,s);
 	if(end-s>4 && !is_ws(s[4]) && s[4]!=',' && s[4]!='}' && s[4]!=']')
-		throw junk(s+4);
+		return fail(parse_errc::junk,s+4);
 	
 	value->value_type = value_type_t::null;
 	return s+4;
@@ -188,9 +198,9 @@ const char *ijson2::Parser::parse_null_value(const char *s, const char *end, Val
 
 const char *ijson2::Parser::parse_false_value(const char *s, const char *end, Value *value) {
 	if(end-s<5 || memcmp(s,"false",5)!=0)
-		throw junk(s);
+		return fail(parse_errc::junk,s);
 	if(end-s>5 && !is_ws(s[5]) && s[5]!=',' && s[5]!='}' && s[5]!=']')
-		throw junk(s+5);
+		return fail(parse_errc::junk,s+5);
 	
 	value->value_type = value_type_t::boolean;
 	value->u.bool_value = false;
@@ -199,9 +209,9 @@ const char *ijson2::Parser::parse_false_value(const char *s, const char *end, Va
 
 const char *ijson2::Parser::parse_true_value(const char *s, const char *end, Value *value) {
 	if(end-s<4 || memcmp(s,"true",4)!=0)
-		throw junk(s);
+		return fail(parse_errc::junk,s);
 	if(end-s>4 && !is_value_end(s[4]))
-		throw junk(s+4);
+		return fail(parse_errc::junk,s+4);
 	
 	value->value_type = value_type_t::boolean;
 	value->u.bool_value = true;
@@ -209,9 +219,11 @@ const char *ijson2::Parser::parse_true_value(const char *s, const char *end, Val
 }
 
 const char *ijson2::Parser::parse_string_value(const char *s, const char *end, Value *value) {
-	new (&value->u.string_value) string_view;
-	value->value_type = value_type_t::string;
-	const char *p = parse_string(s,end,&value->u.string_value);
+	string_view sv;
+	const char *p = parse_string(s,end,&sv);
+	if(!p)
+		return nullptr;
+	*value = sv;
 	return p;
 }
 
@@ -245,9 +257,9 @@ const char *ijson2::Parser::parse_number_value(const char *s, const char *end, V
 			break;
 	}
 	if(p<end && !is_value_end(*p))
-		throw junk(s);
+		return fail(parse_errc::junk,s);
 	if(p==s)
-		throw junk(s); //empty string
+		return fail(parse_errc::junk,s); //empty string
 	//optimization of small integers 0..9
 	if(p==s+1 && s[0]>='0' && s[0]<='9') {
 		value->value_type = value_type_t::number_int64;
@@ -257,7 +269,7 @@ const char *ijson2::Parser::parse_number_value(const char *s, const char *end, V
 #if STRICT_PARSING
 	//more strict checking
 	if(*s=='+')
-		throw unparseable_number(p); //numbers must not start with a plus
+		return fail(parse_errc::unparseable_number,p); //numbers must not start with a plus
 	//check for leading zeros
 	if(p-s>=2) {
 		const char *q = s;
@@ -265,30 +277,30 @@ const char *ijson2::Parser::parse_number_value(const char *s, const char *end, V
 			q++;
 		if(p-q>=2) {
 			if(q[0]=='0' && q[1]!='.' && q[1]!='e')
-				throw unparseable_number(p);
+				return fail(parse_errc::unparseable_number,p);
 		}
 		if(q[0]=='.')
-			throw unparseable_number(p);
+			return fail(parse_errc::unparseable_number,p);
 	}
 	if(decimal_point) {
 		if(decimal_point+1==p)
-			throw unparseable_number(p);
+			return fail(parse_errc::unparseable_number,p);
 		if(decimal_point[1]<'0' || decimal_point[1]>'9')
-			throw unparseable_number(p);
+			return fail(parse_errc::unparseable_number,p);
 	}
 #endif
 	
 	std::string copy(s,p-s);
 	if(float_chars) {
 		if(float_chars>2)
-			throw unparseable_number(s);
+			return fail(parse_errc::unparseable_number,s);
 		char *endptr=nullptr;
 		errno = 0;
 		double d = strtod(copy.c_str(),&endptr);
 		if(endptr && *endptr)
-			throw unparseable_number(s);
+			return fail(parse_errc::unparseable_number,s);
 		if((d==HUGE_VAL || d==-HUGE_VAL) && errno==ERANGE)
-			throw unparseable_number(s);
+			return fail(parse_errc::unparseable_number,s);
 		value->value_type = value_type_t::number_double;
 		value->u.number_doublevalue = d;
 	} else {
@@ -296,9 +308,9 @@ const char *ijson2::Parser::parse_number_value(const char *s, const char *end, V
 		errno = 0;
 		long long l = strtoll(copy.c_str(),&endptr,10);
 		if(endptr && *endptr)
-			throw unparseable_number(s);
+			return fail(parse_errc::unparseable_number,s);
 		if((l==LLONG_MAX || l==LLONG_MIN) && errno==ERANGE)
-			throw unparseable_number(s);
+			return fail(parse_errc::unparseable_number,s);
 		value->value_type = value_type_t::number_int64;
 		value->u.number_int64value = l;
 	}
@@ -307,77 +319,93 @@ const char *ijson2::Parser::parse_number_value(const char *s, const char *end, V
 
 
 const char *ijson2::Parser::parse_array_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels) {
-	new (&value->u.array_elements) Value::array_type;
+	value->u.array_elements = nullptr;
 	value->value_type = value_type_t::array;
 	bool first = true;
 	const char *p = s+1;
 	while(p<end) {
 		p = skip_ws(p,end);
 		if(p==end)
-			throw unterminated_array(p);
+			return fail(parse_errc::unterminated_array,p);
 		if(*p==']')
 			return p+1;
 		if(!first) {
 			if(*p!=',')
-				throw junk(p);
+				return fail(parse_errc::junk,p);
 			p++;
 			p = skip_ws(p,end);
 		}
-		value->u.array_elements.push_back(Value());
-		p = parse_value(p,end,&value->u.array_elements.back(),max_nesting_levels);
+		Value::array_type &elements = value->array();
+		elements.push_back(Value());
+		p = parse_value(p,end,&elements.back(),max_nesting_levels);
+		if(!p)
+			return nullptr;
 		first = false;
 	}
-	throw unterminated_array(s);
+	return fail(parse_errc::unterminated_array,s);
 }
 
 
 const char *ijson2::Parser::parse_object_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels) {
-	new (&value->u.object_members) Value::map_type;
+	value->u.object_members = nullptr;
 	value->value_type = value_type_t::object;
 	bool first = true;
 	const char *p = s+1;
 	while(p<end) {
 		p = skip_ws(p,end);
 		if(p==end)
-			throw unterminated_object(p);
+			return fail(parse_errc::unterminated_object,p);
 		if(*p=='}')
 			return p+1;
 		if(!first) {
 			if(*p!=',')
-				throw junk(p);
+				return fail(parse_errc::junk,p);
 			p++;
 			p = skip_ws(p,end);
 		}
 		if(*p!='"')
-			throw expected_string(p);
+			return fail(parse_errc::expected_string,p);
 		
 		string_view sv;
 		p = parse_string(p,end,&sv);
+		if(!p)
+			return nullptr;
 		p = skip_ws(p,end);
 		if(p==end || *p!=':')
-			throw expected_colon(p);
+			return fail(parse_errc::expected_colon,p);
 		p++;
 		p = skip_ws(p,end);
-		value->u.object_members[sv];
-		p = parse_value(p,end,&value->u.object_members[sv],max_nesting_levels);
+		Value &member = value->object()[sv];
+		member = nullptr; //duplicate member names: last one wins
+		if(!raw_member_names.empty() && is_raw_member(sv)) {
+			const char *start = p;
+			p = skip_value(p,end,max_nesting_levels);
+			if(!p)
+				return nullptr;
+			member = Value::from_raw_json(string_view(start,size_t(p-start)));
+		} else {
+			p = parse_value(p,end,&member,max_nesting_levels);
+			if(!p)
+				return nullptr;
+		}
 		first = false;
 	}
-	throw unterminated_object(p);
+	return fail(parse_errc::unterminated_object,p);
 }
 
 
 const char *ijson2::Parser::parse_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels) {
 	s = skip_ws(s,end);
 	if(s==end)
-		throw expected_value(s);
+		return fail(parse_errc::expected_value,s);
 	switch(s[0])  {
 		case '{':
 			if(max_nesting_levels==0)
-				throw too_many_levels(s);
+				return fail(parse_errc::too_many_levels,s);
 			return parse_object_value(s,end,value,max_nesting_levels-1);
 		case '[':
 			if(max_nesting_levels==0)
-				throw too_many_levels(s);
+				return fail(parse_errc::too_many_levels,s);
 			return parse_array_value(s,end,value,max_nesting_levels-1);
 		case '"':
 			return parse_string_value(s,end,value);
@@ -394,6 +422,149 @@ const char *ijson2::Parser::parse_value(const char *s, const char *end, Value *v
 
 
 
+bool ijson2::Parser::is_raw_member(const string_view &name) const {
+	for(const auto &n : raw_member_names)
+		if(name==string_view(n.data(),n.size()))
+			return true;
+	return false;
+}
+
+
+//Validation without building values, for raw members. Mirrors parse_array_value()/parse_object_value()
+
+//Like parse_string() but only checks the string, without unescaping it into the arena
+const char *ijson2::Parser::skip_string(const char *s, const char *end) {
+	if(end-s<2)
+		return fail(parse_errc::unterminated_string,s);
+	const char *p = s+1;
+	while(p<end) {
+		char c = *p;
+		if(c=='"')
+			return p+1;
+#if STRICT_PARSING
+		if((uint8_t)c<32)
+			return fail(parse_errc::missing_escape,p);
+#endif
+		if(c!='\\') {
+			p++;
+			continue;
+		}
+		if(p+1==end)
+			return fail(parse_errc::unterminated_string,s);
+		switch(p[1]) {
+			case '"':
+			case '\\':
+			case '/':
+			case 'b':
+			case 'f':
+			case 'n':
+			case 'r':
+			case 't':
+				p += 2;
+				break;
+			case 'u': {
+				uint32_t uc;
+				char utf8[4];
+				if(p+1+1+4 >= end || !unicode_escape_value(p+2,&uc) || uc_to_utf8(uc,utf8)==0)
+					return fail(parse_errc::invalid_escape,p);
+				p += 6;
+				break;
+			}
+			default:
+				return fail(parse_errc::invalid_escape,p);
+		}
+	}
+	return fail(parse_errc::unterminated_string,s);
+}
+
+
+const char *ijson2::Parser::skip_array(const char *s, const char *end, unsigned max_nesting_levels) {
+	bool first = true;
+	const char *p = s+1;
+	while(p<end) {
+		p = skip_ws(p,end);
+		if(p==end)
+			return fail(parse_errc::unterminated_array,p);
+		if(*p==']')
+			return p+1;
+		if(!first) {
+			if(*p!=',')
+				return fail(parse_errc::junk,p);
+			p++;
+			p = skip_ws(p,end);
+		}
+		p = skip_value(p,end,max_nesting_levels);
+		if(!p)
+			return nullptr;
+		first = false;
+	}
+	return fail(parse_errc::unterminated_array,s);
+}
+
+
+const char *ijson2::Parser::skip_object(const char *s, const char *end, unsigned max_nesting_levels) {
+	bool first = true;
+	const char *p = s+1;
+	while(p<end) {
+		p = skip_ws(p,end);
+		if(p==end)
+			return fail(parse_errc::unterminated_object,p);
+		if(*p=='}')
+			return p+1;
+		if(!first) {
+			if(*p!=',')
+				return fail(parse_errc::junk,p);
+			p++;
+			p = skip_ws(p,end);
+		}
+		if(*p!='"')
+			return fail(parse_errc::expected_string,p);
+		p = skip_string(p,end);
+		if(!p)
+			return nullptr;
+		p = skip_ws(p,end);
+		if(p==end || *p!=':')
+			return fail(parse_errc::expected_colon,p);
+		p++;
+		p = skip_ws(p,end);
+		p = skip_value(p,end,max_nesting_levels);
+		if(!p)
+			return nullptr;
+		first = false;
+	}
+	return fail(parse_errc::unterminated_object,p);
+}
+
+
+const char *ijson2::Parser::skip_value(const char *s, const char *end, unsigned max_nesting_levels) {
+	s = skip_ws(s,end);
+	if(s==end)
+		return fail(parse_errc::expected_value,s);
+	Value scalar;
+	switch(s[0])  {
+		case '{':
+			if(max_nesting_levels==0)
+				return fail(parse_errc::too_many_levels,s);
+			return skip_object(s,end,max_nesting_levels-1);
+		case '[':
+			if(max_nesting_levels==0)
+				return fail(parse_errc::too_many_levels,s);
+			return skip_array(s,end,max_nesting_levels-1);
+		case '"':
+			return skip_string(s,end);
+		case 'f':
+			return parse_false_value(s,end,&scalar);
+		case 'n':
+			return parse_null_value(s,end,&scalar);
+		case 't':
+			return parse_true_value(s,end,&scalar);
+		default:
+			return parse_number_value(s,end,&scalar);
+	}
+}
+
+
+
 bool ijson2::Parser::may_be_complete(const char *s, size_t sz) {
 	const char *end = s+sz;
 	s = skip_ws(s,end);
@@ -419,15 +590,79 @@ bool ijson2::Parser::may_be_complete(const char *s, size_t sz) {
 }
 
 
-void ijson2::Parser::parse(const char *s, size_t sz, unsigned max_nesting_levels) {
+ijson2::parse_result ijson2::Parser::try_parse(const char *s, size_t sz, unsigned max_nesting_levels) noexcept {
 	//skip BOM if present
 	if(sz>=3 && s[0]==(char)0xEF && s[1]==(char)0xBB && s[2]==(char)0xBF) {
 		s += 3;
 		sz -= 3;
 	}
 	
-	const char *e = parse_value(s,s+sz, &top_value, max_nesting_levels);
-	e = skip_ws(e,s+sz);
-	if(e!=s+sz)
-		throw junk(e);
+	try {
+		top_value = nullptr; //the parse functions overwrite the value without releasing what it held
+		const char *e = parse_value(s,s+sz, &top_value, max_nesting_levels);
+		if(!e)
+			return parse_result{error_code,error_where};
+		e = skip_ws(e,s+sz);
+		if(e!=s+sz)
+			return parse_result{parse_errc::junk,e};
+	} catch(const std::bad_alloc &) {
+		return parse_result{parse_errc::out_of_memory,nullptr};
+	}
+	return parse_result{parse_errc::ok,nullptr};
+}
+
+
+void ijson2::Parser::parse(const char *s, size_t sz, unsigned max_nesting_levels) {
+	parse_result r = try_parse(s,sz,max_nesting_levels);
+	if(r.error!=parse_errc::ok)
+		throw_parser_error(r);
+}
+
+
+const char *ijson2::to_string(parse_errc e) noexcept {
+	switch(e) {
+		case parse_errc::ok:                  return "ok";
+		case parse_errc::unterminated_string: return "unterminated string";
+		case parse_errc::unterminated_object: return "unterminated object";
+		case parse_errc::unterminated_array:  return "unterminated array";
+		case parse_errc::junk:                return "junk";
+		case parse_errc::unparseable_number:  return "unparseable number";
+		case parse_errc::expected_string:     return "expected string";
+		case parse_errc::expected_colon:      return "expected colon";
+		case parse_errc::expected_comma:      return "expected comma";
+		case parse_errc::expected_value:      return "expected value";
+		case parse_errc::too_many_levels:     return "too many levels";
+		case parse_errc::invalid_escape:      return "invalid escape";
+		case parse_errc::missing_escape:      return "missing escape";
+		case parse_errc::out_of_memory:       return "out of memory";
+	}
+	return "unknown error";
+}
+
+
+void ijson2::throw_parser_error(const parse_result &r) {
+	switch(r.error) {
+		case parse_errc::ok:                  return;
+		case parse_errc::unterminated_string: throw unterminated_string(r.where);
+		case parse_errc::unterminated_object: throw unterminated_object(r.where);
+		case parse_errc::unterminated_array:  throw unterminated_array(r.where);
+		case parse_errc::junk:                throw junk(r.where);
+		case parse_errc::unparseable_number:  throw unparseable_number(r.where);
+		case parse_errc::expected_string:     throw expected_string(r.where);
+		case parse_errc::expected_colon:      throw expected_colon(r.where);
+		case parse_errc::expected_comma:      throw expected_comma(r.where);
+		case parse_errc::expected_value:      throw expected_value(r.where);
+		case parse_errc::too_many_levels:     throw too_many_levels(r.where);
+		case parse_errc::invalid_escape:      throw invalid_escape(r.where);
+		case parse_errc::missing_escape:      throw missing_escape(r.where);
+		case parse_errc::out_of_memory:       throw std::bad_alloc();
+	}
+	throw parser_error(to_string(r.error),r.where);
+}
+
+
+ijson2::Document ijson2::Parser::release() noexcept {
+	Document document(std::move(memory_arena),std::move(top_value));
+	top_value = nullptr;
+	return document;
 }
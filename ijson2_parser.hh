@@ -2,15 +2,49 @@
 #define IJSON2_PARSER_HH_
 #include "ijson2.hh"
 #include "ijson2_memory_arena.hh"
+#include "ijson2_document.hh"
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace ijson2 {
 
+//Errors reported by Parser::try_parse(). Each one except out_of_memory
+//corresponds to the parser_error subclass of the same name.
+enum class parse_errc : uint8_t {
+	ok,
+	unterminated_string,
+	unterminated_object,
+	unterminated_array,
+	junk,
+	unparseable_number,
+	expected_string,
+	expected_colon,
+	expected_comma,
+	expected_value,
+	too_many_levels,
+	invalid_escape,
+	missing_escape,
+	out_of_memory
+};
+
+struct parse_result {
+	parse_errc error;
+	const char *where;  //points into the given data like parser_error::where(). nullptr when ok or out_of_memory
+	explicit operator bool() const { return error==parse_errc::ok; }
+};
+
+
 class Parser {
 	MemoryArena memory_arena;
 	Value top_value;
+	std::vector<std::string> raw_member_names;
+	parse_errc error_code;
+	const char *error_where;
 public:
 	Parser()
+	  : error_code(parse_errc::ok),
+	    error_where(nullptr)
 	{}
 	~Parser() {
 	}
@@ -21,9 +55,29 @@ public:
 	static bool may_be_complete(const char *s, size_t sz);
 	
 	void parse(const char *s, size_t sz, unsigned max_nesting_levels=64);
+	//Like parse() but malformed input (and running out of memory) is reported
+	//in the result instead of by an exception, which is much cheaper when
+	//lots of the input is bad. parse() is a wrapper around this.
+	parse_result try_parse(const char *s, size_t sz, unsigned max_nesting_levels=64) noexcept;
+	
+	//The values of object members with these names (at any level) are
+	//validated but not parsed into trees. They become raw_json values
+	//referring to the parsed data, which the formatters output verbatim.
+	void set_raw_members(const std::vector<std::string> &names) { raw_member_names = names; }
 	
 	const Value &value() const { return top_value; }
+	
+	//Hand over the parsed value together with the memory arena holding the
+	//unescaped strings. The parser is left empty and can be reused.
+	//Strings which didn't need unescaping still refer to the parsed data.
+	Document release() noexcept;
 private:
+	//Errors are recorded here and nullptr is returned all the way up
+	const char *fail(parse_errc e, const char *where) {
+		error_code = e;
+		error_where = where;
+		return nullptr;
+	}
 	const char *parse_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels);
 	const char *parse_object_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels);
 	const char *parse_array_value(const char *s, const char *end, Value *value, unsigned max_nesting_levels);
@@ -33,6 +87,11 @@ private:
 	const char *parse_false_value(const char *s, const char *end, Value *value);
 	const char *parse_null_value(const char *s, const char *end, Value *value);
 	const char *parse_string(const char *s, const char *end, string_view *sv);
+	bool is_raw_member(const string_view &name) const;
+	const char *skip_string(const char *s, const char *end);
+	const char *skip_value(const char *s, const char *end, unsigned max_nesting_levels);
+	const char *skip_object(const char *s, const char *end, unsigned max_nesting_levels);
+	const char *skip_array(const char *s, const char *end, unsigned max_nesting_levels);
 };
 
 
@@ -131,6 +190,14 @@ public:
 };
 
 
+//The message of the exception for the error code
+const char *to_string(parse_errc e) noexcept;
+
+//Throw the parser_error subclass for the error (std::bad_alloc for
+//out_of_memory). Returns if the result is ok
+void throw_parser_error(const parse_result &r);
+
+
 } //namespace
 
 #endif
@@ -136,42 +136,42 @@ int main() {
 		TestParser p;
 		p.parse("\"\"");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==0);
+		assert(p.value().string().size()==0);
 	}
 	{
 		TestParser p;
 		p.parse("\"abc\"");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==3);
-		assert(memcmp(p.value().u.string_value.data(),"abc",3)==0);
+		assert(p.value().string().size()==3);
+		assert(memcmp(p.value().string().data(),"abc",3)==0);
 	}
 	{
 		TestParser p;
 		p.parse("\"ab\\\"c\"");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==4);
-		assert(memcmp(p.value().u.string_value.data(),"ab\"c",4)==0);
+		assert(p.value().string().size()==4);
+		assert(memcmp(p.value().string().data(),"ab\"c",4)==0);
 	}
 	{
 		TestParser p;
 		p.parse("\"abc\"  ");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==3);
-		assert(memcmp(p.value().u.string_value.data(),"abc",3)==0);
+		assert(p.value().string().size()==3);
+		assert(memcmp(p.value().string().data(),"abc",3)==0);
 	}
 	{
 		TestParser p;
 		p.parse("  \"abc\"");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==3);
-		assert(memcmp(p.value().u.string_value.data(),"abc",3)==0);
+		assert(p.value().string().size()==3);
+		assert(memcmp(p.value().string().data(),"abc",3)==0);
 	}
 	{
 		TestParser p;
 		p.parse("\"abc\"\r\n");
 		assert(p.value().value_type==value_type_t::string);
-		assert(p.value().u.string_value.size()==3);
-		assert(memcmp(p.value().u.string_value.data(),"abc",3)==0);
+		assert(p.value().string().size()==3);
+		assert(memcmp(p.value().string().data(),"abc",3)==0);
 	}
 	{
 		TestParser p;
@@ -213,43 +213,43 @@ int main() {
 		TestParser p;
 		p.parse("[]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.empty());
+		assert(p.value().array().empty());
 	}
 	{
 		TestParser p;
 		p.parse("[17]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.size()==1);
-		assert(p.value().u.array_elements[0].value_type==value_type_t::number_int64);
-		assert(p.value().u.array_elements[0].u.number_int64value==17);
+		assert(p.value().array().size()==1);
+		assert(p.value().array()[0].value_type==value_type_t::number_int64);
+		assert(p.value().array()[0].u.number_int64value==17);
 	}
 	{
 		TestParser p;
 		p.parse("[\"abc\"]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.size()==1);
-		assert(p.value().u.array_elements[0].value_type==value_type_t::string);
-		assert(p.value().u.array_elements[0].u.string_value=="abc");
+		assert(p.value().array().size()==1);
+		assert(p.value().array()[0].value_type==value_type_t::string);
+		assert(p.value().array()[0].string()=="abc");
 	}
 	{
 		TestParser p;
 		p.parse("[\"a\"]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.size()==1);
-		assert(p.value().u.array_elements[0].value_type==value_type_t::string);
-		assert(p.value().u.array_elements[0].u.string_value=="a");
+		assert(p.value().array().size()==1);
+		assert(p.value().array()[0].value_type==value_type_t::string);
+		assert(p.value().array()[0].string()=="a");
 	}
 	{
 		TestParser p;
 		p.parse("[17, 18,19]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.size()==3);
-		assert(p.value().u.array_elements[0].value_type==value_type_t::number_int64);
-		assert(p.value().u.array_elements[0].u.number_int64value==17);
-		assert(p.value().u.array_elements[1].value_type==value_type_t::number_int64);
-		assert(p.value().u.array_elements[1].u.number_int64value==18);
-		assert(p.value().u.array_elements[2].value_type==value_type_t::number_int64);
-		assert(p.value().u.array_elements[2].u.number_int64value==19);
+		assert(p.value().array().size()==3);
+		assert(p.value().array()[0].value_type==value_type_t::number_int64);
+		assert(p.value().array()[0].u.number_int64value==17);
+		assert(p.value().array()[1].value_type==value_type_t::number_int64);
+		assert(p.value().array()[1].u.number_int64value==18);
+		assert(p.value().array()[2].value_type==value_type_t::number_int64);
+		assert(p.value().array()[2].u.number_int64value==19);
 	}
 	{
 		TestParser p;
@@ -273,51 +273,51 @@ int main() {
 		TestParser p;
 		p.parse("{}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.empty());
+		assert(p.value().object().empty());
 	}
 	{
 		TestParser p;
 		p.parse("{\"foo\":17}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==1);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("foo").u.number_int64value==17);
+		assert(p.value().object().size()==1);
+		assert(p.value().object().at("foo").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("foo").u.number_int64value==17);
 	}
 	{
 		TestParser p;
 		p.parse("  {  \"foo\"  :  17  }  ");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==1);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("foo").u.number_int64value==17);
+		assert(p.value().object().size()==1);
+		assert(p.value().object().at("foo").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("foo").u.number_int64value==17);
 	}
 	{
 		TestParser p;
 		p.parse("{\"foo\":17,\"boo\":42}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==2);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("foo").u.number_int64value==17);
-		assert(p.value().u.object_members.at("boo").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("boo").u.number_int64value==42);
+		assert(p.value().object().size()==2);
+		assert(p.value().object().at("foo").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("foo").u.number_int64value==17);
+		assert(p.value().object().at("boo").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("boo").u.number_int64value==42);
 	}
 	{
 		TestParser p;
 		p.parse("{\"foo\":\"boo\"}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==1);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::string);
-		assert(p.value().u.object_members.at("foo").u.string_value=="boo");
+		assert(p.value().object().size()==1);
+		assert(p.value().object().at("foo").value_type==value_type_t::string);
+		assert(p.value().object().at("foo").string()=="boo");
 	}
 	{
 		TestParser p;
 		p.parse("{\"foo\":17,\"boo\":\"goo\"}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==2);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("foo").u.number_int64value==17);
-		assert(p.value().u.object_members.at("boo").value_type==value_type_t::string);
-		assert(p.value().u.object_members.at("boo").u.string_value=="goo");
+		assert(p.value().object().size()==2);
+		assert(p.value().object().at("foo").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("foo").u.number_int64value==17);
+		assert(p.value().object().at("boo").value_type==value_type_t::string);
+		assert(p.value().object().at("boo").string()=="goo");
 	}
 	{
 		TestParser p;
@@ -333,9 +333,9 @@ int main() {
 		TestParser p;
 		p.parse("{\"start\": 1565115093136, \"end\": 1565115113136, \"queries\": [{\"aggregator\": \"avg\", \"metric\": \"temperature\"}]}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==3);
-		assert(p.value().u.object_members.at("start").value_type==value_type_t::number_int64);
-		assert(p.value().u.object_members.at("end").value_type==value_type_t::number_int64);
+		assert(p.value().object().size()==3);
+		assert(p.value().object().at("start").value_type==value_type_t::number_int64);
+		assert(p.value().object().at("end").value_type==value_type_t::number_int64);
 	}
 	
 	printf("Parsing arrays (complex)\n");
@@ -343,7 +343,7 @@ int main() {
 		TestParser p;
 		p.parse("[{\"foo\":[17]},{\"boo\":42},117,false]");
 		assert(p.value().value_type==value_type_t::array);
-		assert(p.value().u.array_elements.size()==4);
+		assert(p.value().array().size()==4);
 	}
 	
 	printf("Parsing objects (complex)\n");
@@ -351,9 +351,9 @@ int main() {
 		TestParser p;
 		p.parse("{\"foo\":[17,42],\"boo\":{\"goo\":117}}");
 		assert(p.value().value_type==value_type_t::object);
-		assert(p.value().u.object_members.size()==2);
-		assert(p.value().u.object_members.at("foo").value_type==value_type_t::array);
-		assert(p.value().u.object_members.at("boo").value_type==value_type_t::object);
+		assert(p.value().object().size()==2);
+		assert(p.value().object().at("foo").value_type==value_type_t::array);
+		assert(p.value().object().at("boo").value_type==value_type_t::object);
 	}
 	
 	printf("Parsing too-deep object\n");
@@ -379,5 +379,130 @@ int main() {
 		assert(p.value().u.number_int64value==1);
 	}
 	
+	printf("Releasing the parsed value\n");
+	{
+		Document doc;
+		{
+			TestParser p;
+			p.parse("{\"foo\":[17,\"a string with an \\\"escape\\\" in it\"]}");
+			doc = p.release();
+			assert(p.value().is_null());
+			p.parse("[42]");
+			assert(p.value().array()[0].int64value()==42);
+		}
+		assert(doc.value().object().at("foo").array()[0].int64value()==17);
+		assert(doc.value().object().at("foo").array()[1].string()=="a string with an \"escape\" in it");
+	}
+	
+	printf("Parsing raw members\n");
+	{
+		TestParser p;
+		p.set_raw_members({"payload","x"});
+		p.parse("{\"id\":1, \"payload\": {\"a\" : [1, 2.5, \"s\\n\"],\"b\":{}} ,\"list\":[{\"x\":true},{\"y\":[0]}]}");
+		const Value &v = p.value();
+		assert(v.at("id").int64value()==1);
+		assert(v.at("payload").value_type==value_type_t::raw_json);
+		assert(v.at("payload").raw_json()=="{\"a\" : [1, 2.5, \"s\\n\"],\"b\":{}}");
+		assert(v.at("list").array()[0].at("x").raw_json()=="true");
+		assert(v.at("list").array()[1].at("y").array()[0].int64value()==0);
+		
+		//raw members are still validated
+		static const char *bad[] = {
+			"{\"x\":[1,}",
+			"{\"x\":{\"a\" 1}}",
+			"{\"x\":{1:1}}",
+			"{\"x\":\"\\q\"}",
+			"{\"x\":01}",
+			"{\"x\":nul}",
+			"{\"x\":[[[[[[]]]]]]}",
+			"{\"x\":",
+		};
+		for(const char *json : bad) {
+			TestParser p2;
+			p2.set_raw_members({"x"});
+			try {
+				p2.parse(json,5);
+				assert(false);
+			} catch(const parser_error &) {
+			}
+		}
+		
+		//strings in raw members are only checked, with the same result as when they are parsed
+		static const char *strings[] = {
+			"{\"x\":\"a\\n\\\"b\\/\\u0041\"}",
+			"{\"x\":{\"k\\ty\":[\"\\\\\",\"\\b\\f\\r\"]}}",
+			"{\"x\":\"\\q\"}",
+			"{\"x\":\"\\u12\"}",
+			"{\"x\":\"\\u12g4\"}",
+			"{\"x\":\"\\u\"}",
+			"{\"x\":{\"\\q\":1}}",
+			"{\"x\":\"abc",
+			"{\"x\":\"abc\\",
+		};
+		for(const char *json : strings) {
+			TestParser raw, parsed;
+			raw.set_raw_members({"x"});
+			parse_result r1 = raw.try_parse(json,strlen(json));
+			parse_result r2 = parsed.try_parse(json,strlen(json));
+			assert(r1.error==r2.error);
+			assert(r1.where==r2.where);
+			if(r1)
+				assert(raw.value().at("x").value_type==value_type_t::raw_json);
+		}
+	}
+	
+	printf("Error codes instead of exceptions\n");
+	{
+		static const struct {
+			const char *json;
+			parse_errc error;
+			size_t where;
+		} bad[] = {
+			{"\"abc", parse_errc::unterminated_string, 0},
+			{"{\"a\":1", parse_errc::unterminated_object, 6},
+			{"[1,2", parse_errc::unterminated_array, 0},
+			{"[1 2]", parse_errc::junk, 3},
+			{"01", parse_errc::unparseable_number, 2},
+			{"{1:2}", parse_errc::expected_string, 1},
+			{"{\"a\" 1}", parse_errc::expected_colon, 5},
+			{"", parse_errc::expected_value, 0},
+			{"[[[]]]", parse_errc::too_many_levels, 2},
+			{"\"\\q\"", parse_errc::invalid_escape, 1},
+			{"\"a\tb\"", parse_errc::missing_escape, 2},
+			{"[1] x", parse_errc::junk, 4},
+			{"{\"x\":[1,}", parse_errc::junk, 8},
+		};
+		for(const auto &b : bad) {
+			TestParser p;
+			p.set_raw_members({"x"});
+			parse_result r = p.try_parse(b.json,strlen(b.json),2);
+			assert(!r);
+			assert(r.error==b.error);
+			assert(r.where==b.json+b.where);
+			//the same as the exception
+			try {
+				p.parse(b.json,2);
+				assert(false);
+			} catch(const parser_error &e) {
+				assert(e.where()==r.where);
+				assert(strcmp(e.what(),to_string(r.error))==0);
+			}
+			try {
+				throw_parser_error(r);
+			} catch(const parser_error &e) {
+				assert(e.where()==r.where);
+			}
+		}
+		
+		TestParser p;
+		const char *json = "{\"a\":[1,\"x\\ny\"]}";
+		parse_result r = p.try_parse(json,strlen(json));
+		assert(r);
+		assert(r.error==parse_errc::ok);
+		assert(r.where==nullptr);
+		throw_parser_error(r); //returns
+		assert(p.value().at("a").array()[1].string()=="x\ny");
+	}
+	
 	return 0;
 }
@@ -0,0 +1,158 @@
+#include "ijson2_prepared_template.hh"
+
+
+std::string ijson2::PreparedTemplate::render(const TemplateArgument *args, size_t count) const {
+	std::string s;
+	s.reserve(text.size()+count*16);
+	StringSink sink(s);
+	render_to(sink,args,count);
+	return s;
+}
+
+
+
+ijson2::TemplateBuilder::TemplateBuilder(bool pretty_, nonfinite_policy_t nonfinite_policy_)
+  : pretty(pretty_),
+    nonfinite_policy(nonfinite_policy_),
+    sink(text),
+    compact_formatter(sink,nonfinite_policy_),
+    pretty_formatter(sink,nonfinite_policy_),
+    level(pretty_ ? 0 : -1)
+{
+}
+
+
+void ijson2::TemplateBuilder::open_object() {
+	if(pretty) {
+		pretty_formatter.open_object();
+		level++;
+	} else
+		compact_formatter.open_object();
+}
+
+
+void ijson2::TemplateBuilder::close_object() {
+	if(pretty) {
+		pretty_formatter.close_object();
+		level--;
+	} else
+		compact_formatter.close_object();
+}
+
+
+void ijson2::TemplateBuilder::open_array() {
+	if(pretty) {
+		pretty_formatter.open_array();
+		level++;
+	} else
+		compact_formatter.open_array();
+}
+
+
+void ijson2::TemplateBuilder::close_array() {
+	if(pretty) {
+		pretty_formatter.close_array();
+		level--;
+	} else
+		compact_formatter.close_array();
+}
+
+
+void ijson2::TemplateBuilder::member(const string_view &name) {
+	if(pretty)
+		pretty_formatter.member(name);
+	else
+		compact_formatter.member(name);
+}
+
+
+void ijson2::TemplateBuilder::member(const PreparedKey &key) {
+	if(pretty)
+		pretty_formatter.member(key);
+	else
+		compact_formatter.member(key);
+}
+
+
+void ijson2::TemplateBuilder::append_string(const string_view &sv) {
+	if(pretty)
+		pretty_formatter.append_string(sv);
+	else
+		compact_formatter.append_string(sv);
+}
+
+
+void ijson2::TemplateBuilder::append_number(int64_t i) {
+	if(pretty)
+		pretty_formatter.append_number(i);
+	else
+		compact_formatter.append_number(i);
+}
+
+
+void ijson2::TemplateBuilder::append_number(uint64_t u) {
+	if(pretty)
+		pretty_formatter.append_number(u);
+	else
+		compact_formatter.append_number(u);
+}
+
+
+void ijson2::TemplateBuilder::append_number(double d) {
+	if(pretty)
+		pretty_formatter.append_number(d);
+	else
+		compact_formatter.append_number(d);
+}
+
+
+void ijson2::TemplateBuilder::append_boolean(bool b) {
+	if(pretty)
+		pretty_formatter.append_boolean(b);
+	else
+		compact_formatter.append_boolean(b);
+}
+
+
+void ijson2::TemplateBuilder::append_null() {
+	if(pretty)
+		pretty_formatter.append_null();
+	else
+		compact_formatter.append_null();
+}
+
+
+void ijson2::TemplateBuilder::append_raw_json(const string_view &json) {
+	if(pretty)
+		pretty_formatter.append_raw_json(json);
+	else
+		compact_formatter.append_raw_json(json);
+}
+
+
+void ijson2::TemplateBuilder::append_value(const Value &v) {
+	if(pretty)
+		pretty_formatter.append_value(v);
+	else
+		compact_formatter.append_value(v);
+}
+
+
+size_t ijson2::TemplateBuilder::placeholder() {
+	//an empty raw value gives the separator and indentation of a value
+	append_raw_json(string_view("",0));
+	slots.push_back(PreparedTemplate::slot_t{sink.size(),level});
+	return slots.size()-1;
+}
+
+
+ijson2::PreparedTemplate ijson2::TemplateBuilder::finish() {
+	if(pretty)
+		pretty_formatter.finish();
+	else
+		compact_formatter.finish();
+	PreparedTemplate t(nonfinite_policy);
+	t.text = text;
+	t.slots = slots;
+	return t;
+}
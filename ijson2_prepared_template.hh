@@ -0,0 +1,185 @@
+#ifndef IJSON2_PREPARED_TEMPLATE_HH_
+#define IJSON2_PREPARED_TEMPLATE_HH_
+#include "ijson2_direct_formatter.hh"
+#include "ijson2_sink.hh"
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+//Output with a fixed shape where only a few values change, eg. the responses
+//of a service. The shape is described once with TemplateBuilder, using the
+//same calls as BasicDirectFormatter plus placeholder(). The constant parts are
+//formatted at that point, so rendering only copies them and formats the values
+//given for the placeholders. The output is the same as DirectFormatter and
+//BasicDirectFormatter produce for the equivalent calls, in compact and pretty
+//mode.
+
+namespace ijson2 {
+
+//A value for a placeholder. Strings and values are referred to, not copied
+class TemplateArgument {
+	enum class kind_t : uint8_t {
+		string,
+		number_int64,
+		number_uint64,
+		number_double,
+		boolean,
+		null,
+		raw_json,
+		value
+	};
+	kind_t kind;
+	size_t length;   //of string and raw_json
+	union {
+		const char *s;
+		int64_t i;
+		uint64_t u;
+		double d;
+		bool b;
+		const Value *v;
+	};
+	TemplateArgument(kind_t kind_, const char *s_, size_t length_) : kind(kind_), length(length_), s(s_) {}
+public:
+	TemplateArgument(const string_view &sv) : TemplateArgument(kind_t::string,sv.data(),sv.size()) {}
+	TemplateArgument(const std::string &str) : TemplateArgument(kind_t::string,str.data(),str.size()) {}
+	TemplateArgument(const char *str) : TemplateArgument(string_view(str)) {}
+	TemplateArgument(int64_t i_) : kind(kind_t::number_int64), length(0), i(i_) {}
+	TemplateArgument(int32_t i_) : TemplateArgument(static_cast<int64_t>(i_)) {}
+	TemplateArgument(uint32_t u_) : TemplateArgument(static_cast<uint64_t>(u_)) {}
+	TemplateArgument(uint64_t u_) : kind(kind_t::number_uint64), length(0), u(u_) {}
+	TemplateArgument(double d_) : kind(kind_t::number_double), length(0), d(d_) {}
+	TemplateArgument(bool b_) : kind(kind_t::boolean), length(0), b(b_) {}
+	TemplateArgument(std::nullptr_t) : kind(kind_t::null), length(0), s(nullptr) {}
+	TemplateArgument(const Value &v_) : kind(kind_t::value), length(0), v(&v_) {}
+	//valid JSON text, output verbatim
+	static TemplateArgument raw_json(const string_view &json) { return TemplateArgument(kind_t::raw_json,json.data(),json.size()); }
+
+	template<class Sink>
+	void format(Sink &sink, int level, nonfinite_policy_t nonfinite_policy) const {
+		switch(kind) {
+			case kind_t::string:
+				formatting::append_string(string_view(s,length),sink);
+				break;
+			case kind_t::number_int64:
+				formatting::append_int64(i,sink);
+				break;
+			case kind_t::number_uint64: {
+				char *p = sink.reserve(formatting::max_integer_length);
+				sink.commit(formatting::format_uint64(u,p)-p);
+				break;
+			}
+			case kind_t::number_double:
+				formatting::append_double(d,sink,nonfinite_policy);
+				break;
+			case kind_t::boolean:
+				if(b)
+					sink.append("true",4);
+				else
+					sink.append("false",5);
+				break;
+			case kind_t::null:
+				sink.append("null",4);
+				break;
+			case kind_t::raw_json: {
+				using formatting::append_unescaped;
+				append_unescaped(sink,s,length);
+				break;
+			}
+			case kind_t::value:
+				formatting::format_value(*v,sink,level,nonfinite_policy);
+				break;
+		}
+	}
+};
+
+
+class PreparedTemplate {
+	struct slot_t {
+		size_t offset;   //in text
+		int level;       //nesting level for pretty output, -1 when compact
+	};
+	std::string text;   //the constant parts
+	std::vector<slot_t> slots;
+	nonfinite_policy_t nonfinite_policy;
+	friend class TemplateBuilder;
+	PreparedTemplate(nonfinite_policy_t nonfinite_policy_) : nonfinite_policy(nonfinite_policy_) {}
+public:
+	size_t placeholder_count() const { return slots.size(); }
+
+	//Output the template with the placeholders filled in by index, and flush
+	//the sink. The constant parts are referred to (see IovecSink) so the
+	//template must outlive the output.
+	template<class Sink>
+	void render_to(Sink &sink, const TemplateArgument *args, size_t count) const {
+		if(count!=slots.size())
+			throw invalid_structure("Wrong number of template arguments");
+		//unqualified, so sinks which refer to the text in place (IovecSink) are found
+		using formatting::append_unescaped;
+		size_t pos = 0;
+		for(size_t i=0; i<count; i++) {
+			append_unescaped(sink,text.data()+pos,slots[i].offset-pos);
+			args[i].format(sink,slots[i].level,nonfinite_policy);
+			pos = slots[i].offset;
+		}
+		append_unescaped(sink,text.data()+pos,text.size()-pos);
+		sink.flush();
+	}
+	template<class Sink>
+	void render_to(Sink &sink, std::initializer_list<TemplateArgument> args) const {
+		render_to(sink,args.begin(),args.size());
+	}
+
+	std::string render(const TemplateArgument *args, size_t count) const;
+	std::string render(std::initializer_list<TemplateArgument> args) const { return render(args.begin(),args.size()); }
+};
+
+
+//Describes the shape of a template. Misuse throws invalid_structure like
+//BasicDirectFormatter does
+class TemplateBuilder {
+	bool pretty;
+	nonfinite_policy_t nonfinite_policy;
+	std::string text;
+	StringSink sink;
+	BasicDirectFormatter<false,StringSink> compact_formatter;
+	BasicDirectFormatter<true,StringSink> pretty_formatter;
+	int level;
+	std::vector<PreparedTemplate::slot_t> slots;
+public:
+	explicit TemplateBuilder(bool pretty_=false, nonfinite_policy_t nonfinite_policy_=nonfinite_policy_t::error);
+	TemplateBuilder(const TemplateBuilder&) = delete;
+	TemplateBuilder& operator=(const TemplateBuilder&) = delete;
+
+	void open_object();
+	void close_object();
+	void open_array();
+	void close_array();
+	void member(const string_view &name);
+	void member(const std::string &name) { member(string_view(name.data(),name.size())); }
+	void member(const char *name) { member(string_view(name)); }
+	void member(const PreparedKey &key);
+
+	//constant values
+	void append_string(const string_view &sv);
+	void append_string(const std::string &s) { append_string(string_view(s.data(),s.size())); }
+	void append_string(const char *s) { append_string(string_view(s)); }
+	void append_number(int64_t i);
+	void append_number(int32_t i) { append_number(static_cast<int64_t>(i)); }
+	void append_number(uint32_t i) { append_number(static_cast<uint64_t>(i)); }
+	void append_number(uint64_t u);
+	void append_number(double d);
+	void append_boolean(bool b);
+	void append_null();
+	void append_raw_json(const string_view &json);
+	void append_value(const Value &v);
+
+	//A value given when rendering. Returns the index of the placeholder
+	size_t placeholder();
+
+	//The top-level value must be complete
+	PreparedTemplate finish();
+};
+
+} //namespace ijson2
+
+#endif
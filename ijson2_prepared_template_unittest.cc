@@ -0,0 +1,222 @@
+#include "ijson2_prepared_template.hh"
+#include <stdio.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <string>
+
+using ijson2::PreparedTemplate;
+using ijson2::TemplateArgument;
+using ijson2::TemplateBuilder;
+
+
+static PreparedTemplate make_response_template(bool pretty) {
+	TemplateBuilder tb(pretty);
+	tb.open_object();
+	tb.member("status");
+	tb.append_string("ok");
+	tb.member("id");
+	tb.placeholder();
+	tb.member("user");
+	tb.open_object();
+	tb.member("name");
+	tb.placeholder();
+	tb.member("tags");
+	tb.open_array();
+	tb.placeholder();
+	tb.append_string("fixed");
+	tb.placeholder();
+	tb.close_array();
+	tb.close_object();
+	tb.member("score");
+	tb.placeholder();
+	tb.member("extra");
+	tb.placeholder();
+	tb.member("empty");
+	tb.open_array();
+	tb.close_array();
+	tb.close_object();
+	return tb.finish();
+}
+
+
+//the same output with DirectFormatter
+static std::string direct_response(bool pretty, int64_t id, const char *name, bool tag0, uint64_t tag2, double score, const ijson2::Value &extra) {
+	std::string s;
+	auto append = [](const char *src, size_t srcsize, void *append_context) {
+		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
+	};
+	ijson2::DirectFormatter df(append,&s,pretty);
+	df.open_object();
+	df.begin_object_member("status");
+	df.append_string("ok");
+	df.append_object_member_separator();
+	df.begin_object_member("id");
+	df.append_number(id);
+	df.append_object_member_separator();
+	df.begin_object_member("user");
+	df.open_object();
+	df.begin_object_member("name");
+	df.append_string(name);
+	df.append_object_member_separator();
+	df.begin_object_member("tags");
+	df.open_array();
+	df.append_boolean(tag0);
+	df.append_array_member_separator();
+	df.append_string("fixed");
+	df.append_array_member_separator();
+	df.append_number(tag2);
+	df.close_array();
+	df.close_object();
+	df.append_object_member_separator();
+	df.begin_object_member("score");
+	df.append_number(score);
+	df.append_object_member_separator();
+	df.begin_object_member("extra");
+	std::string extra_json = ijson2::format_to_string(extra,false);
+	df.append_raw_json(ijson2::string_view(extra_json.data(),extra_json.size()));
+	df.append_object_member_separator();
+	df.begin_object_member("empty");
+	df.open_array();
+	df.close_array();
+	df.close_object();
+	df.flush();
+	return s;
+}
+
+
+int main() {
+	printf("compact and pretty output is the same as DirectFormatter's\n");
+	{
+		ijson2::Value extra;
+		for(int pretty=0; pretty<2; pretty++) {
+			PreparedTemplate t = make_response_template(pretty);
+			assert(t.placeholder_count()==6);
+			std::string name("J\"o\te");
+			std::string s = t.render({INT64_C(-17), name, true, UINT64_MAX, 0.25, extra});
+			assert(s==direct_response(pretty,-17,name.c_str(),true,UINT64_MAX,0.25,extra));
+			s = t.render({INT64_C(42), "", false, UINT64_C(0), 1e300, extra});
+			assert(s==direct_response(pretty,42,"",false,0,1e300,extra));
+		}
+		{
+			std::string s = make_response_template(false).render({1, "a", true, 2u, 0.5, nullptr});
+			assert(s=="{\"status\":\"ok\",\"id\":1,\"user\":{\"name\":\"a\",\"tags\":[true,\"fixed\",2]},\"score\":0.5,\"extra\":null,\"empty\":[]}");
+		}
+	}
+	
+	printf("values and raw JSON as arguments\n");
+	{
+		ijson2::Value v{ijson2::Value::map_type{}};
+		v.object()["a"] = ijson2::Value::array_type{ijson2::Value(1),ijson2::Value("x")};
+		v.object()["b"] = ijson2::Value::map_type{};
+		for(int pretty=0; pretty<2; pretty++) {
+			TemplateBuilder tb(pretty);
+			tb.open_array();
+			tb.open_object();
+			tb.member("v");
+			tb.placeholder();
+			tb.close_object();
+			tb.placeholder();
+			tb.close_array();
+			PreparedTemplate t = tb.finish();
+			
+			ijson2::Value expected{ijson2::Value::array_type{ijson2::Value(ijson2::Value::map_type{}),ijson2::Value(v)}};
+			expected.array()[0].object()["v"] = v;
+			assert(t.render({v,v})==ijson2::format_to_string(expected,pretty));
+			expected.array()[1] = ijson2::Value::from_raw_json("[1, 2]");
+			assert(t.render({v,TemplateArgument::raw_json("[1, 2]")})==ijson2::format_to_string(expected,pretty));
+		}
+	}
+	
+	printf("constant parts and top-level placeholders\n");
+	{
+		TemplateBuilder tb;
+		tb.placeholder();
+		PreparedTemplate t = tb.finish();
+		assert(t.render({"x"})=="\"x\"");
+		assert(t.render({-1.5})=="-1.5");
+		
+		TemplateBuilder tb2(true);
+		tb2.open_array();
+		tb2.append_null();
+		tb2.append_number(3.0);
+		tb2.append_value(ijson2::Value("v"));
+		tb2.close_array();
+		PreparedTemplate t2 = tb2.finish();
+		assert(t2.placeholder_count()==0);
+		assert(t2.render({})=="[\n\tnull,\n\t3,\n\t\"v\"\n]\n");
+	}
+	
+	printf("rendering into sinks\n");
+	{
+		PreparedTemplate t = make_response_template(false);
+		ijson2::Value extra(7);
+		std::string s("prefix");
+		ijson2::StringSink sink(s);
+		t.render_to(sink,{1, "a", true, 2u, 0.5, extra});
+		assert(s=="prefix"+direct_response(false,1,"a",true,2,0.5,extra));
+		
+		std::string s2;
+		ijson2::IovecSink iov_sink;
+		t.render_to(iov_sink,{1, "a", true, 2u, 0.5, extra});
+		for(const auto &iov : iov_sink.iovecs())
+			s2.append(static_cast<const char*>(iov.iov_base),iov.iov_len);
+		assert(s2==direct_response(false,1,"a",true,2,0.5,extra));
+		
+		//long raw JSON arguments are referred to in place
+		static const char payload[] = "{\"opaque\":\"a payload which is long enough to be referenced in place\"}";
+		ijson2::IovecSink iov_sink2;
+		t.render_to(iov_sink2,{1, "a", true, 2u, 0.5, TemplateArgument::raw_json(payload)});
+		bool referenced = false;
+		for(const auto &iov : iov_sink2.iovecs())
+			if(iov.iov_base==payload)
+				referenced = true;
+		assert(referenced);
+		
+		//and so are long constant parts, which the template owns
+		TemplateBuilder b;
+		b.open_array();
+		b.append_string("a constant string which is long enough to be referenced in place");
+		b.placeholder();
+		b.close_array();
+		PreparedTemplate t2 = b.finish();
+		ijson2::IovecSink iov_sink3;
+		t2.render_to(iov_sink3,{3});
+		//copied, everything would end up in one chunk
+		assert(iov_sink3.iovecs().size()==2);
+		std::string s3;
+		for(const auto &iov : iov_sink3.iovecs())
+			s3.append(static_cast<const char*>(iov.iov_base),iov.iov_len);
+		assert(s3==t2.render({3}));
+	}
+	
+	printf("errors\n");
+	{
+		PreparedTemplate t = make_response_template(false);
+		try {
+			t.render({1, "a"});
+			assert(false);
+		} catch(const ijson2::invalid_structure &) {
+		}
+		try {
+			t.render({1, "a", true, 2u, NAN, nullptr});
+			assert(false);
+		} catch(const ijson2::nonfinite_number &) {
+		}
+		
+		auto misuse = [](void (*f)(TemplateBuilder&)) {
+			TemplateBuilder tb;
+			try {
+				f(tb);
+				assert(false);
+			} catch(const ijson2::invalid_structure &) {
+			}
+		};
+		misuse([](TemplateBuilder &tb) { tb.open_object(); tb.placeholder(); });
+		misuse([](TemplateBuilder &tb) { tb.placeholder(); tb.placeholder(); });
+		misuse([](TemplateBuilder &tb) { tb.open_array(); tb.placeholder(); tb.finish(); });
+		misuse([](TemplateBuilder &tb) { tb.open_array(); tb.close_object(); });
+	}
+	
+	return 0;
+}
@@ -0,0 +1,195 @@
+#include "ijson2_pull_formatter.hh"
+#include "ijson2_sink.hh"
+#include <string.h>
+
+
+ijson2::PullFormatter::PullFormatter(const Value &v, bool pretty_, nonfinite_policy_t nonfinite_policy_)
+  : root(v),
+    pretty(pretty_),
+    nonfinite_policy(nonfinite_policy_),
+    state(state_t::start),
+    pending_pos(0),
+    current_string_pos(0),
+    in_string(false),
+    current_raw_pos(0)
+{
+}
+
+
+static void append_indent(std::string &s, int level) {
+	//yes, we use tabs.
+	if(level>0)
+		s.append(static_cast<size_t>(level),'\t');
+}
+
+
+void ijson2::PullFormatter::begin_string(const string_view &sv) {
+	pending += '"';
+	current_string = sv;
+	current_string_pos = 0;
+	in_string = true;
+}
+
+
+void ijson2::PullFormatter::begin_value(const Value &v, int level) {
+	if(level<0) {
+		if(const std::string *m = v.memoized_compact(nonfinite_policy)) {
+			current_raw = string_view(m->data(),m->size());
+			current_raw_pos = 0;
+			return;
+		}
+	}
+	switch(v.value_type) {
+		case value_type_t::object:
+			if(v.object().empty())
+				pending += "{}";
+			else {
+				pending += '{';
+				stack.push_back(Frame{&v,0,v.object().begin(),level,false});
+			}
+			break;
+		case value_type_t::array:
+			if(v.array().empty())
+				pending += "[]";
+			else {
+				pending += '[';
+				stack.push_back(Frame{&v,0,Value::map_type::const_iterator(),level,false});
+			}
+			break;
+		case value_type_t::string:
+			begin_string(v.string());
+			break;
+		case value_type_t::raw_json:
+			current_raw = v.raw_json();
+			current_raw_pos = 0;
+			break;
+		default: {
+			StringSink sink(pending);
+			formatting::format_value(v,sink,level,nonfinite_policy);
+			sink.flush();
+			break;
+		}
+	}
+}
+
+
+//Generate the next piece of output into pending (or start a string)
+void ijson2::PullFormatter::step() {
+	if(state==state_t::start) {
+		state = state_t::next;
+		begin_value(root,pretty?0:-1);
+		return;
+	}
+	if(stack.empty()) {
+		if(pretty)
+			pending += '\n';
+		state = state_t::done;
+		return;
+	}
+	Frame &f = stack.back();
+	int inner_level = f.level>=0 ? f.level+1 : f.level;
+	if(f.container->value_type==value_type_t::array) {
+		const Value::array_type &a = f.container->array();
+		if(f.index<a.size()) {
+			if(f.index>0)
+				pending += ',';
+			if(f.level>=0) pending += '\n';
+			append_indent(pending,inner_level);
+			const Value &e = a[f.index++];
+			begin_value(e,inner_level);   //may invalidate f
+			return;
+		}
+		if(f.level>=0) pending += '\n';
+		append_indent(pending,f.level);
+		pending += ']';
+		stack.pop_back();
+	} else {
+		const Value::map_type &o = f.container->object();
+		if(f.after_name) {
+			pending += ':';
+			f.after_name = false;
+			const Value &e = (f.member++)->second;
+			begin_value(e,inner_level);   //may invalidate f
+			return;
+		}
+		if(f.member!=o.end()) {
+			if(f.member!=o.begin())
+				pending += ',';
+			if(f.level>=0) pending += '\n';
+			append_indent(pending,inner_level);
+			f.after_name = true;
+			begin_string(f.member->first);
+			return;
+		}
+		if(f.level>=0) pending += '\n';
+		append_indent(pending,f.level);
+		pending += '}';
+		stack.pop_back();
+	}
+}
+
+
+//Output the current string escaped, directly into dst as far as there is room
+size_t ijson2::PullFormatter::produce_string(char *dst, size_t dstsize) {
+	size_t produced = 0;
+	while(current_string_pos<current_string.size() && produced<dstsize) {
+		const char *s = current_string.data()+current_string_pos;
+		size_t l = current_string.size()-current_string_pos;
+		size_t room = dstsize-produced;
+		size_t clean = formatting::unescaped_prefix_length(s,l<room?l:room);
+		memcpy(dst+produced,s,clean);
+		produced += clean;
+		current_string_pos += clean;
+		if(clean==l || produced==dstsize)
+			break;
+		const formatting::escape_sequence_t &e = formatting::escape_sequence[static_cast<uint8_t>(s[clean])];
+		current_string_pos++;
+		if(e.length<=dstsize-produced) {
+			memcpy(dst+produced,e.chars,e.length);
+			produced += e.length;
+		} else {
+			//hand out the rest of the escape sequence later
+			pending.append(e.chars,e.length);
+			return produced;
+		}
+	}
+	if(current_string_pos==current_string.size()) {
+		pending += '"';
+		in_string = false;
+	}
+	return produced;
+}
+
+
+size_t ijson2::PullFormatter::produce(char *dst, size_t dstsize) {
+	size_t produced = 0;
+	for(;;) {
+		if(pending_pos<pending.size()) {
+			size_t l = pending.size()-pending_pos;
+			if(l>dstsize-produced)
+				l = dstsize-produced;
+			memcpy(dst+produced,pending.data()+pending_pos,l);
+			produced += l;
+			pending_pos += l;
+			if(pending_pos<pending.size())
+				return produced; //dst is full
+			pending.clear();
+			pending_pos = 0;
+		}
+		if(produced==dstsize)
+			return produced;
+		if(current_raw_pos<current_raw.size()) {
+			size_t l = current_raw.size()-current_raw_pos;
+			if(l>dstsize-produced)
+				l = dstsize-produced;
+			memcpy(dst+produced,current_raw.data()+current_raw_pos,l);
+			produced += l;
+			current_raw_pos += l;
+		} else if(in_string)
+			produced += produce_string(dst+produced,dstsize-produced);
+		else if(state==state_t::done)
+			return produced;
+		else
+			step();
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef IJSON2_PULL_FORMATTER_HH_
+#define IJSON2_PULL_FORMATTER_HH_
+#include "ijson2_formatter.hh"
+#include <string>
+#include <vector>
+
+//A formatter which produces the output piecemeal on request, eg. when a
+//non-blocking socket becomes writable. It remembers its position in the value
+//tree so memory use doesn't depend on the size of the output. The output is
+//identical to format(). The value tree must not be modified while it is being
+//formatted.
+
+namespace ijson2 {
+
+class PullFormatter {
+public:
+	PullFormatter(const Value &v, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error);
+	
+	//Produce up to dstsize bytes of output. Returns the number of bytes
+	//produced, which is only less than dstsize when the output is complete.
+	size_t produce(char *dst, size_t dstsize);
+	
+	bool done() const { return state==state_t::done && pending_pos==pending.size() && current_raw_pos==current_raw.size(); }
+	
+private:
+	struct Frame {
+		const Value *container;
+		size_t index;                          //array element
+		Value::map_type::const_iterator member;
+		int level;
+		bool after_name;                       //object member name has been output, value is next
+	};
+	enum class state_t { start, next, done };
+	
+	const Value &root;
+	bool pretty;
+	nonfinite_policy_t nonfinite_policy;
+	state_t state;
+	std::vector<Frame> stack;
+	std::string pending;                        //punctuation, numbers etc. not yet handed out
+	size_t pending_pos;
+	string_view current_string;                 //string being output, without the closing quote
+	size_t current_string_pos;
+	bool in_string;
+	string_view current_raw;                    //memoized text or raw JSON being output
+	size_t current_raw_pos;
+	
+	void step();
+	void begin_value(const Value &v, int level);
+	void begin_string(const string_view &sv);
+	size_t produce_string(char *dst, size_t dstsize);
+};
+
+} //namespace
+
+#endif
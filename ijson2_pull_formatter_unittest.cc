@@ -0,0 +1,121 @@
+#include "ijson2_pull_formatter.hh"
+#include "ijson2_parser.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+
+using namespace ijson2;
+
+
+//pull all of the output in pieces of at most n bytes
+static std::string pull(const Value &v, bool pretty, size_t n, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error) {
+	PullFormatter formatter(v,pretty,nonfinite_policy);
+	std::string result;
+	char buf[4096];
+	while(!formatter.done()) {
+		size_t l = formatter.produce(buf,n);
+		assert(l<=n);
+		assert(l==n || formatter.done());
+		result.append(buf,l);
+	}
+	assert(formatter.produce(buf,n)==0);
+	return result;
+}
+
+
+static void check(const Value &v) {
+	for(bool pretty : {false,true}) {
+		std::string expected = format_to_string(v,pretty);
+		for(size_t n=1; n<=20; n++)
+			assert(pull(v,pretty,n)==expected);
+		assert(pull(v,pretty,64)==expected);
+		assert(pull(v,pretty,4096)==expected);
+	}
+}
+
+
+static void check(const char *json, unsigned max_nesting_levels=64) {
+	Parser parser;
+	parser.parse(json,strlen(json),max_nesting_levels);
+	check(parser.value());
+}
+
+
+int main(void) {
+	printf("Scalars\n");
+	check("null");
+	check("true");
+	check("-9223372036854775808");
+	check("0.1");
+	check("\"\"");
+	check("\"a\\\"b\\\\c\\u0001d\\n\"");
+	
+	printf("Containers\n");
+	check("[]");
+	check("{}");
+	check("[[],{},[[]],{\"\":{}}]");
+	check("{\"a\":[1,-2.5,\"x\\ty\",true,null],\"b\":{\"c\":1e300}}");
+	check("[{\"a\\u0002b\":\"\\u001f\\u001f\\u001f\"},[1,[2,[3]]],\"end\"]");
+	
+	printf("Long strings\n");
+	{
+		std::string s;
+		for(int i=0; i<10000; i++)
+			s += static_cast<char>(i%128);
+		Value v{Value::array_type()};
+		v.array().push_back(Value(string_view(s.data(),s.size())));
+		Value::map_type o;
+		o[string_view(s.data(),300)] = Value(string_view(s.data()+100,500));
+		v.array().push_back(Value(o));
+		check(v);
+	}
+	
+	printf("Deep nesting\n");
+	{
+		std::string json;
+		for(int i=0; i<100; i++)
+			json += "[{\"k\":";
+		json += "0";
+		for(int i=0; i<100; i++)
+			json += "}]";
+		check(json.c_str(),1000);
+	}
+	
+	printf("Memoized subtrees\n");
+	{
+		static const char json[] = "{\"a\":[1,{\"b\":\"c\\n\"}],\"d\":[true,[]]}";
+		Parser parser;
+		parser.parse(json,sizeof(json)-1);
+		Value shared(parser.value());
+		shared.share();
+		const Value &v = shared;
+		memoize_compact(v.at("a"));
+		memoize_compact(v.at("d").array()[0]); //ignored
+		assert(v.at("a").memoized_compact());
+		check(v);
+		memoize_compact(v);
+		check(v);
+	}
+	
+	printf("NaN and infinity\n");
+	{
+		Value v{Value::array_type()};
+		v.array().push_back(Value(1));
+		v.array().push_back(Value(NAN));
+		assert(pull(v,false,3,nonfinite_policy_t::null)=="[1,null]");
+		assert(pull(v,true,1,nonfinite_policy_t::string)==format_to_string(v,true,nonfinite_policy_t::string));
+		PullFormatter formatter(v);
+		char buf[64];
+		bool caught=false;
+		try {
+			formatter.produce(buf,sizeof(buf));
+		} catch(nonfinite_number &) {
+			caught = true;
+		}
+		assert(caught);
+	}
+	
+	return 0;
+}
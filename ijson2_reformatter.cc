@@ -0,0 +1,365 @@
+#include "ijson2_reformatter.hh"
+#include "ijson2_parser.hh"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+//Number of leading JSON whitespace characters
+static size_t whitespace_prefix_length(const char *s, size_t l) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	for(; i+16<=l; i+=16) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+i));
+		__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x,space),_mm_cmpeq_epi8(x,tab)),
+		                          _mm_or_si128(_mm_cmpeq_epi8(x,nl),_mm_cmpeq_epi8(x,cr)));
+		unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xffff;
+		if(mask!=0)
+			return i+__builtin_ctz(mask);
+	}
+#endif
+	for(; i<l; i++)
+		if(s[i]!=' ' && s[i]!='\t' && s[i]!='\n' && s[i]!='\r')
+			return i;
+	return l;
+}
+
+
+static bool is_digit(char c) {
+	return c>='0' && c<='9';
+}
+
+static bool is_hex_digit(char c) {
+	return is_digit(c) || (c>='a' && c<='f') || (c>='A' && c<='F');
+}
+
+//Characters which can occur in numbers
+static bool is_number_char(char c) {
+	return is_digit(c) || c=='-' || c=='+' || c=='.' || c=='e' || c=='E';
+}
+
+
+ijson2::Reformatter::Reformatter(append_fn_t append_pfn, void *append_context, bool pretty_, unsigned max_nesting_levels_)
+  : sink(append_pfn,append_context),
+    pretty(pretty_),
+    max_nesting_levels(max_nesting_levels_),
+    expect(expect_t::value),
+    open_pending(false),
+    in_string(false),
+    string_is_name(false),
+    escape_pending(false),
+    hex_digits_pending(0),
+    scalar(scalar_t::none),
+    literal(nullptr),
+    literal_pos(0)
+{
+}
+
+
+//The number state after the character, or none if it can't continue the number
+ijson2::Reformatter::scalar_t ijson2::Reformatter::next_number_state(scalar_t state, char c) {
+	switch(state) {
+		case scalar_t::number:
+			if(c=='-')
+				return scalar_t::minus;
+			//fall through
+		case scalar_t::minus:
+			if(c=='0')
+				return scalar_t::zero;
+			if(is_digit(c))
+				return scalar_t::int_digits;
+			break;
+		case scalar_t::int_digits:
+			if(is_digit(c))
+				return scalar_t::int_digits;
+			//fall through
+		case scalar_t::zero:
+			if(c=='.')
+				return scalar_t::dot;
+			if(c=='e' || c=='E')
+				return scalar_t::exponent;
+			break;
+		case scalar_t::dot:
+		case scalar_t::frac_digits:
+			if(is_digit(c))
+				return scalar_t::frac_digits;
+			if(state==scalar_t::frac_digits && (c=='e' || c=='E'))
+				return scalar_t::exponent;
+			break;
+		case scalar_t::exponent:
+			if(c=='+' || c=='-')
+				return scalar_t::exponent_sign;
+			//fall through
+		case scalar_t::exponent_sign:
+		case scalar_t::exponent_digits:
+			if(is_digit(c))
+				return scalar_t::exponent_digits;
+			break;
+		case scalar_t::none:
+		case scalar_t::literal:
+			break;
+	}
+	return scalar_t::none;
+}
+
+//Whether a number can end in the state
+bool ijson2::Reformatter::is_number_complete(scalar_t state) {
+	return state==scalar_t::zero || state==scalar_t::int_digits || state==scalar_t::frac_digits || state==scalar_t::exponent_digits;
+}
+
+
+//A string, number, literal or container starts. Check that it is expected and lay out the first element of a container
+void ijson2::Reformatter::begin_token(const char *p) {
+	switch(expect) {
+		case expect_t::value:
+		case expect_t::first_value_or_close:
+			string_is_name = false;
+			break;
+		case expect_t::first_member_or_close:
+		case expect_t::member:
+			if(*p!='"')
+				throw expected_string(p);
+			string_is_name = true;
+			break;
+		case expect_t::colon:
+			throw expected_colon(p);
+		case expect_t::comma_or_close:
+			throw expected_comma(p);
+		case expect_t::end:
+			throw junk(p);
+	}
+	if(open_pending) {
+		if(pretty) {
+			sink.append("\n",1);
+			formatting::append_indent(sink,static_cast<int>(containers.size()));
+		}
+		open_pending = false;
+	}
+}
+
+
+void ijson2::Reformatter::end_value() {
+	expect = containers.empty() ? expect_t::end : expect_t::comma_or_close;
+}
+
+
+//After a backslash: check and copy the rest of the escape sequence, which may continue in the next chunk
+const char *ijson2::Reformatter::escape_chars(const char *p, const char *end) {
+	const char *start = p;
+	if(escape_pending && p<end) {
+		switch(*p) {
+			case '"':
+			case '\\':
+			case '/':
+			case 'b':
+			case 'f':
+			case 'n':
+			case 'r':
+			case 't':
+				break;
+			case 'u':
+				hex_digits_pending = 4;
+				break;
+			default:
+				throw invalid_escape(p);
+		}
+		escape_pending = false;
+		p++;
+	}
+	for(; hex_digits_pending>0 && p<end; p++, hex_digits_pending--)
+		if(!is_hex_digit(*p))
+			throw invalid_escape(p);
+	sink.append(start,p-start);
+	return p;
+}
+
+
+//Inside a string: copy up to and including the closing quote
+const char *ijson2::Reformatter::string_chars(const char *p, const char *end) {
+	if(escape_pending || hex_digits_pending>0)
+		p = escape_chars(p,end);
+	while(p<end) {
+		size_t clean = formatting::unescaped_prefix_length(p,end-p);
+		sink.append(p,clean);
+		p += clean;
+		if(p==end)
+			break;
+		char c = *p;
+		if(c=='"') {
+			sink.append(p,1);
+			in_string = false;
+			if(string_is_name)
+				expect = expect_t::colon;
+			else
+				end_value();
+			return p+1;
+		}
+		if(c!='\\')
+			throw missing_escape(p);
+		sink.append(p,1);
+		escape_pending = true;
+		p = escape_chars(p+1,end);
+	}
+	return p;
+}
+
+
+//Inside a number or literal: check and copy up to its end
+const char *ijson2::Reformatter::scalar_chars(const char *p, const char *end) {
+	const char *start = p;
+	if(scalar==scalar_t::literal) {
+		for(; p<end && literal[literal_pos]!='\0'; p++, literal_pos++)
+			if(*p!=literal[literal_pos])
+				throw junk(p);
+		sink.append(start,p-start);
+		if(literal[literal_pos]=='\0') {
+			//what follows is checked as the next token
+			scalar = scalar_t::none;
+			end_value();
+		}
+		return p;
+	}
+	for(; p<end; p++) {
+		scalar_t next = next_number_state(scalar,*p);
+		if(next==scalar_t::none)
+			break;
+		scalar = next;
+	}
+	sink.append(start,p-start);
+	if(p<end) {
+		//eg. "01", "1.2.3" or "-"
+		if(!is_number_complete(scalar) || is_number_char(*p))
+			throw unparseable_number(p);
+		scalar = scalar_t::none;
+		end_value();
+	}
+	return p;
+}
+
+
+//Outside strings and scalars: p points to a non-whitespace character
+const char *ijson2::Reformatter::structural(const char *p) {
+	char c = *p;
+	switch(c) {
+		case '{':
+		case '[':
+			begin_token(p);
+			if(containers.size()>=max_nesting_levels)
+				throw too_many_levels(p);
+			containers.push_back(c);
+			sink.append(p,1);
+			open_pending = true;
+			expect = c=='{' ? expect_t::first_member_or_close : expect_t::first_value_or_close;
+			return p+1;
+		case '}':
+		case ']': {
+			char open = c=='}' ? '{' : '[';
+			if(containers.empty() || containers.back()!=open)
+				throw junk(p);
+			if(open_pending) {
+				if(expect!=expect_t::first_member_or_close && expect!=expect_t::first_value_or_close)
+					throw junk(p);
+				open_pending = false;
+			} else {
+				if(expect!=expect_t::comma_or_close)
+					throw expected_value(p);
+				if(pretty) {
+					sink.append("\n",1);
+					formatting::append_indent(sink,static_cast<int>(containers.size())-1);
+				}
+			}
+			containers.pop_back();
+			sink.append(p,1);
+			end_value();
+			return p+1;
+		}
+		case ',':
+			if(expect!=expect_t::comma_or_close)
+				throw junk(p);
+			sink.append(p,1);
+			if(pretty) {
+				sink.append("\n",1);
+				formatting::append_indent(sink,static_cast<int>(containers.size()));
+			}
+			expect = containers.back()=='{' ? expect_t::member : expect_t::value;
+			return p+1;
+		case ':':
+			if(expect!=expect_t::colon)
+				throw junk(p);
+			sink.append(p,1);
+			expect = expect_t::value;
+			return p+1;
+		case '"':
+			begin_token(p);
+			sink.append(p,1);
+			in_string = true;
+			return p+1;
+		case 't':
+		case 'f':
+		case 'n':
+			begin_token(p);
+			literal = c=='t' ? "true" : c=='f' ? "false" : "null";
+			literal_pos = 0;
+			scalar = scalar_t::literal;
+			return p;
+		default:
+			if(c!='-' && !is_digit(c))
+				throw junk(p);
+			begin_token(p);
+			scalar = scalar_t::number;
+			return p;
+	}
+}
+
+
+void ijson2::Reformatter::feed(const char *s, size_t l) {
+	const char *p = s;
+	const char *end = s+l;
+	while(p<end) {
+		if(in_string)
+			p = string_chars(p,end);
+		else if(scalar!=scalar_t::none)
+			p = scalar_chars(p,end);
+		else {
+			p += whitespace_prefix_length(p,end-p);
+			if(p<end)
+				p = structural(p);
+		}
+	}
+}
+
+
+void ijson2::Reformatter::finish() {
+	if(in_string)
+		throw unterminated_string(nullptr);
+	if(scalar==scalar_t::literal)
+		throw junk(nullptr);
+	if(scalar!=scalar_t::none) {
+		if(!is_number_complete(scalar))
+			throw unparseable_number(nullptr);
+		scalar = scalar_t::none;
+		end_value();
+	}
+	if(!containers.empty()) {
+		if(containers.back()=='{')
+			throw unterminated_object(nullptr);
+		else
+			throw unterminated_array(nullptr);
+	}
+	if(expect!=expect_t::end)
+		throw expected_value(nullptr);
+	if(pretty)
+		sink.append("\n",1);
+	sink.flush();
+}
+
+
+void ijson2::reformat(const char *s, size_t l, append_fn_t append_pfn, void *append_context, bool pretty) {
+	Reformatter reformatter(append_pfn,append_context,pretty);
+	reformatter.feed(s,l);
+	reformatter.finish();
+}
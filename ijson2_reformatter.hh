@@ -0,0 +1,82 @@
+#ifndef IJSON2_REFORMATTER_HH_
+#define IJSON2_REFORMATTER_HH_
+#include "ijson2_formatter.hh"
+#include "ijson2_sink.hh"
+#include <vector>
+
+//Minifying and pretty-printing JSON text without building a value tree. The
+//input can be fed in chunks of any size and memory use is constant (apart from
+//the nesting stack). Whitespace is laid out like format() does, but strings,
+//numbers and literals are copied as they are, eg. escapes and number notation
+//are kept. The input is checked like the parser does: the structure (brackets,
+//commas, colons), the literals, the number grammar and the escape sequences.
+//Errors are reported with the exceptions from ijson2_parser.hh; where() points
+//into the chunk being fed, or is nullptr when finish() finds the input
+//incomplete.
+
+namespace ijson2 {
+
+class Reformatter {
+public:
+	Reformatter(append_fn_t append_pfn, void *append_context, bool pretty=false, unsigned max_nesting_levels=64);
+	Reformatter(const Reformatter&) = delete;
+	Reformatter& operator=(const Reformatter&) = delete;
+	
+	void feed(const char *s, size_t l);
+	//The input is complete. Checks that it was a complete value and flushes the output
+	void finish();
+	
+private:
+	enum class expect_t {
+		value,
+		first_value_or_close,   //after '['
+		first_member_or_close,  //after '{'
+		member,                 //after ',' in an object
+		colon,
+		comma_or_close,
+		end                     //after the top-level value
+	};
+	//Inside a number or literal. The number states are named after what was seen last
+	enum class scalar_t {
+		none,
+		literal,
+		number,                 //nothing seen yet
+		minus,
+		zero,                   //leading zero
+		int_digits,
+		dot,
+		frac_digits,
+		exponent,               //e or E
+		exponent_sign,
+		exponent_digits
+	};
+	CallbackSink sink;
+	bool pretty;
+	unsigned max_nesting_levels;
+	std::vector<char> containers;   //'{' or '[' for each open container
+	expect_t expect;
+	bool open_pending;              //a container was opened and its first element hasn't been seen yet
+	bool in_string;
+	bool string_is_name;
+	bool escape_pending;            //a backslash in a string has been seen but not the character after it
+	unsigned hex_digits_pending;    //of a \u escape
+	scalar_t scalar;
+	const char *literal;            //"true", "false" or "null"
+	size_t literal_pos;             //characters of the literal seen so far
+	
+	static scalar_t next_number_state(scalar_t state, char c);
+	static bool is_number_complete(scalar_t state);
+	void begin_token(const char *p);
+	void end_value();
+	const char *escape_chars(const char *p, const char *end);
+	const char *string_chars(const char *p, const char *end);
+	const char *scalar_chars(const char *p, const char *end);
+	const char *structural(const char *p);
+};
+
+//Reformat a complete JSON text
+void reformat(const char *s, size_t l, append_fn_t append_pfn, void *append_context, bool pretty=false);
+
+} //namespace
+
+#endif
@@ -0,0 +1,161 @@
+#include "ijson2_reformatter.hh"
+#include "ijson2_parser.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+using namespace ijson2;
+
+
+static void append(const char *src, size_t srcsize, void *append_context) {
+	reinterpret_cast<std::string*>(append_context)->append(src,srcsize);
+}
+
+
+//reformat json fed in pieces of n bytes
+static std::string reformat_in_pieces(const std::string &json, bool pretty, size_t n) {
+	std::string s;
+	Reformatter reformatter(append,&s,pretty);
+	for(size_t i=0; i<json.size(); i+=n)
+		reformatter.feed(json.data()+i,std::min(n,json.size()-i));
+	reformatter.finish();
+	return s;
+}
+
+
+//The output must be the same as parsing and formatting (for inputs in the formatter's number and escape notation)
+static void check(const std::string &json) {
+	Parser parser;
+	parser.parse(json.data(),json.size());
+	for(bool pretty : {false,true}) {
+		std::string expected = format_to_string(parser.value(),pretty);
+		std::string s;
+		reformat(json.data(),json.size(),append,&s,pretty);
+		assert(s==expected);
+		for(size_t n : {1,2,3,5,7,16,17,33})
+			assert(reformat_in_pieces(json,pretty,n)==expected);
+		//and reformatting the output changes nothing
+		s.clear();
+		reformat(expected.data(),expected.size(),append,&s,pretty);
+		assert(s==expected);
+	}
+}
+
+
+template<class E>
+static void check_error(const char *json) {
+	std::string s;
+	try {
+		reformat(json,strlen(json),append,&s);
+		assert(false);
+	} catch(const E &) {
+	}
+	//also when fed byte by byte
+	try {
+		Reformatter reformatter(append,&s);
+		for(const char *p=json; *p; p++)
+			reformatter.feed(p,1);
+		reformatter.finish();
+		assert(false);
+	} catch(const E &) {
+	}
+}
+
+
+int main(void) {
+	printf("Scalars\n");
+	check("null");
+	check(" true ");
+	check("\n-17\t");
+	check("0.5");
+	check("\"\"");
+	check("\"a\\\"b\\\\c\\u0001d\\n\"");
+	
+	printf("Containers\n");
+	check("[]");
+	check("{ }");
+	check(" [ [ ] , { } , [ [ ] ] , { \"\" : { } } ] ");
+	check("{\"a\":[1,-2.5,\"x\\ty\",true,null],\"b\":{\"c\":1e300}}");
+	check("{\n  \"a\" : [ 1,\r\n 2 ],\n  \"b\" : \"  spaces  inside  \"\n}\n");
+	
+	printf("Long strings and whitespace runs\n");
+	{
+		std::string json = "[";
+		for(int i=0; i<50; i++) {
+			json += std::string(static_cast<size_t>(i),' ') + "\"" + std::string(static_cast<size_t>(i*3),'x') + "\\n\\\"\"" + std::string(static_cast<size_t>(i),'\n');
+			json += i<49 ? "," : "]";
+		}
+		check(json);
+	}
+	
+	printf("Deep nesting\n");
+	{
+		std::string json;
+		for(int i=0; i<30; i++)
+			json += "[{\"k\":";
+		json += "0";
+		for(int i=0; i<30; i++)
+			json += "}]";
+		check(json);
+		check_error<too_many_levels>(("[[[[[[[[" + json + "]]]]]]]]").c_str());
+	}
+	
+	printf("Number and escape notation is kept\n");
+	{
+		std::string s;
+		static const char json[] = "[1.0,1E2,\"\\u00e9\\/\"]";
+		reformat(json,sizeof(json)-1,append,&s,true);
+		assert(s=="[\n\t1.0,\n\t1E2,\n\t\"\\u00e9\\/\"\n]\n");
+	}
+	
+	printf("Errors\n");
+	check_error<unterminated_array>("[1,2");
+	check_error<unterminated_object>("{\"a\":1");
+	check_error<unterminated_string>("\"abc");
+	check_error<unterminated_string>("\"abc\\");
+	check_error<expected_value>("");
+	check_error<expected_value>("[1,]");
+	check_error<expected_value>("{\"a\":}");
+	check_error<expected_string>("{1:2}");
+	check_error<expected_string>("{\"a\":1,2}");
+	check_error<expected_colon>("{\"a\" 1}");
+	check_error<expected_comma>("[1 2]");
+	check_error<expected_comma>("[\"a\"\"b\"]");
+	check_error<junk>("[1}");
+	check_error<junk>("1 2");
+	check_error<junk>("[,1]");
+	check_error<junk>("{\"a\"::1}");
+	check_error<junk>("[1]]");
+	check_error<junk>("[#]");
+	check_error<missing_escape>("\"a\nb\"");
+	
+	printf("Literals, numbers and escapes are checked\n");
+	{
+		static const char json[] = "[0,-0,10,-1.5,0.25e-3,2E+10,1e5,\"\\u00E9\\b\\/\"]";
+		for(size_t n : {1,2,3,5})
+			assert(reformat_in_pieces(json,false,n)==json);
+	}
+	check_error<junk>("[tru]");
+	check_error<junk>("tru");
+	check_error<junk>("{\"a\":nulll}");
+	check_error<junk>("[abc]");
+	check_error<junk>("[True]");
+	check_error<junk>("[+1]");
+	check_error<junk>("[.5]");
+	check_error<unparseable_number>("[01]");
+	check_error<unparseable_number>("[1.2.3]");
+	check_error<unparseable_number>("[-]");
+	check_error<unparseable_number>("[1.]");
+	check_error<unparseable_number>("[1e]");
+	check_error<unparseable_number>("[1e+]");
+	check_error<unparseable_number>("[1-2]");
+	check_error<unparseable_number>("-");
+	check_error<unparseable_number>("1.");
+	check_error<invalid_escape>("[\"\\q\"]");
+	check_error<invalid_escape>("[\"\\u12\"]");
+	check_error<invalid_escape>("[\"\\u12g4\"]");
+	check_error<unterminated_string>("\"\\u12");
+	
+	return 0;
+}
@@ -0,0 +1,566 @@
+#include "ijson2_sidecar_index.hh"
+#include "ijson2_parser.hh"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <system_error>
+
+
+using namespace ijson2;
+
+typedef SidecarIndex::Range Range;
+
+static const char magic[8] = {'i','j','s','o','n','2','s','x'};
+static const uint32_t format_version = 1;
+static const size_t header_size = 40;
+static const size_t scan_chunk_size = 1024*1024;
+
+
+static uint64_t get_le64(const char *p) {
+	const uint8_t *q = reinterpret_cast<const uint8_t*>(p);
+	uint64_t v = 0;
+	for(unsigned i=0; i<8; i++)
+		v |= static_cast<uint64_t>(q[i])<<(i*8);
+	return v;
+}
+
+static void append_le64(std::string *buf, uint64_t v) {
+	for(unsigned i=0; i<8; i++)
+		buf->push_back(static_cast<char>(v>>(i*8)));
+}
+
+
+//"/user/name" -> {"user","name"}
+static std::vector<std::string> split_key_path(const std::string &key_path) {
+	std::vector<std::string> names;
+	if(key_path.empty() || key_path[0]!='/')
+		throw sidecar_index_error("key path must start with '/': "+key_path);
+	size_t start = 1;
+	for(;;) {
+		size_t slash = key_path.find('/',start);
+		names.push_back(key_path.substr(start,slash==std::string::npos?std::string::npos:slash-start));
+		if(slash==std::string::npos)
+			break;
+		start = slash+1;
+	}
+	return names;
+}
+
+
+//The modification time is part of the index so changes to the JSON file are detected
+static void file_identity(int fd, const char *filename, uint64_t *size, uint64_t *mtime) {
+	struct stat st;
+	if(fstat(fd,&st)!=0)
+		throw std::system_error(errno,std::system_category(),filename);
+	*size = static_cast<uint64_t>(st.st_size);
+	*mtime = static_cast<uint64_t>(st.st_mtim.tv_sec)*1000000000 + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+}
+
+
+
+namespace {
+
+//Non-validating scanner which only tracks nesting, strings and member names.
+//It is fed the file in chunks and records the byte ranges of the records and
+//of the values at the key paths.
+class Scanner {
+public:
+	Scanner(const std::vector<std::vector<std::string>> &key_paths_)
+	  : key_paths(key_paths_),
+	    path_ranges(key_paths_.size()),
+	    path_hashes(key_paths_.size()),
+	    max_path_length(0),
+	    chunk_base(0),
+	    state(state_t::value),
+	    string_is_key(false),
+	    next_string_is_key(false),
+	    root_seen(false),
+	    root_is_array(false),
+	    capture_from(0)
+	{
+		for(const auto &p : key_paths)
+			max_path_length = std::max(max_path_length,p.size());
+	}
+
+	void feed(const char *data, size_t n);
+	void finish();
+
+	std::vector<Range> records;
+
+private:
+	enum class state_t { value, string, string_escape, scalar };
+	struct Open {
+		size_t path;    //key path number, or npos for a record
+		size_t depth;
+		uint64_t start;
+		bool capture;   //scalar value text is collected for hashing
+	};
+
+	const std::vector<std::vector<std::string>> &key_paths;
+public:
+	std::vector<std::vector<Range>> path_ranges;
+	std::vector<std::vector<std::pair<uint64_t,uint64_t>>> path_hashes;
+private:
+	size_t max_path_length;
+	uint64_t chunk_base;
+	state_t state;
+	std::vector<char> stack;            //'{' or '['
+	std::vector<std::string> names;     //current member name of the object at each level
+	std::string key;
+	bool string_is_key;
+	bool next_string_is_key;
+	bool root_seen;
+	bool root_is_array;
+	std::vector<Open> open;
+	std::string captured;
+	size_t capture_from;
+
+	void value_start(uint64_t pos, char c);
+	void value_end(const char *data, uint64_t end);
+	void structural(const char *data, size_t i);
+};
+
+
+void Scanner::value_start(uint64_t pos, char c) {
+	size_t depth = stack.size();
+	bool scalar = c!='{' && c!='[';
+	if(depth==0) {
+		if(root_seen)
+			throw sidecar_index_error("junk after top-level value");
+		root_seen = true;
+		root_is_array = c=='[';
+		if(root_is_array)
+			return;
+	}
+	size_t record_depth = root_is_array ? 1 : 0;
+	if(depth==record_depth) {
+		records.push_back(Range{pos,0});
+		for(auto &r : path_ranges)
+			r.push_back(Range{0,0});
+		open.push_back(Open{std::string::npos,depth,pos,false});
+		return;
+	}
+	size_t rel = depth-record_depth;
+	if(rel>max_path_length)
+		return;
+	for(size_t p=0; p<key_paths.size(); p++) {
+		const auto &names_wanted = key_paths[p];
+		if(names_wanted.size()!=rel)
+			continue;
+		bool match = true;
+		for(size_t i=0; i<rel && match; i++)
+			match = stack[record_depth+i]=='{' && names[record_depth+i]==names_wanted[i];
+		if(match) {
+			open.push_back(Open{p,depth,pos,scalar});
+			if(scalar) {
+				captured.clear();
+				capture_from = static_cast<size_t>(pos-chunk_base);
+			}
+		}
+	}
+}
+
+
+void Scanner::value_end(const char *data, uint64_t end) {
+	size_t depth = stack.size();
+	if(!open.empty() && open.back().depth==depth && open.back().capture)
+		captured.append(data+capture_from,static_cast<size_t>(end-chunk_base)-capture_from);
+	while(!open.empty() && open.back().depth==depth) {
+		const Open &o = open.back();
+		Range r{o.start,end-o.start};
+		if(o.path==std::string::npos)
+			records.back() = r;
+		else {
+			size_t record = records.size()-1;
+			path_ranges[o.path][record] = r;
+			if(o.capture) {
+				Parser parser;
+				try {
+					parser.parse(captured.data(),captured.size());
+				} catch(parser_error &) {
+					throw sidecar_index_error("malformed value at offset "+std::to_string(o.start));
+				}
+				path_hashes[o.path].emplace_back(parser.value().hash(),record);
+			}
+		}
+		open.pop_back();
+	}
+}
+
+
+void Scanner::structural(const char *data, size_t i) {
+	char c = data[i];
+	uint64_t pos = chunk_base+i;
+	switch(c) {
+		case ' ': case '\t': case '\n': case '\r':
+			break;
+		case ',':
+			next_string_is_key = !stack.empty() && stack.back()=='{';
+			break;
+		case ':':
+			next_string_is_key = false;
+			break;
+		case '}':
+		case ']':
+			if(stack.empty() || stack.back()!=(c=='}'?'{':'['))
+				throw sidecar_index_error("unbalanced brackets at offset "+std::to_string(pos));
+			stack.pop_back();
+			names.pop_back();
+			next_string_is_key = false;
+			value_end(data,pos+1);
+			break;
+		case '"':
+			if(next_string_is_key) {
+				string_is_key = true;
+				key.clear();
+			} else {
+				string_is_key = false;
+				value_start(pos,c);
+			}
+			next_string_is_key = false;
+			state = state_t::string;
+			break;
+		case '{':
+		case '[':
+			value_start(pos,c);
+			stack.push_back(c);
+			names.emplace_back();
+			next_string_is_key = c=='{';
+			break;
+		default:
+			value_start(pos,c);
+			state = state_t::scalar;
+	}
+}
+
+
+void Scanner::feed(const char *data, size_t n) {
+	size_t i = 0;
+	while(i<n) {
+		switch(state) {
+			case state_t::value:
+				structural(data,i);
+				i++;
+				break;
+			case state_t::string: {
+				//skip ahead to the next quote or backslash
+				size_t j = i;
+				while(j<n && data[j]!='"' && data[j]!='\\')
+					j++;
+				if(string_is_key)
+					key.append(data+i,j-i);
+				if(j==n) {
+					i = n;
+					break;
+				}
+				if(data[j]=='\\') {
+					if(string_is_key)
+						key.push_back('\\');
+					state = state_t::string_escape;
+				} else {
+					state = state_t::value;
+					if(string_is_key)
+						names.back() = key;
+					else
+						value_end(data,chunk_base+j+1);
+				}
+				i = j+1;
+				break;
+			}
+			case state_t::string_escape:
+				if(string_is_key)
+					key.push_back(data[i]);
+				state = state_t::string;
+				i++;
+				break;
+			case state_t::scalar: {
+				char c = data[i];
+				if(c==',' || c==']' || c=='}' || c==' ' || c=='\t' || c=='\n' || c=='\r') {
+					value_end(data,chunk_base+i);
+					state = state_t::value;
+				} else
+					i++;
+				break;
+			}
+		}
+	}
+	if(!open.empty() && open.back().capture) {
+		captured.append(data+capture_from,n-capture_from);
+		capture_from = 0;
+	}
+	chunk_base += n;
+}
+
+
+void Scanner::finish() {
+	if(state==state_t::scalar) {
+		value_end("",chunk_base);
+		state = state_t::value;
+	}
+	if(state!=state_t::value)
+		throw sidecar_index_error("unterminated string");
+	if(!stack.empty())
+		throw sidecar_index_error("unterminated object or array");
+	if(!root_seen)
+		throw sidecar_index_error("empty file");
+}
+
+} //anonymous namespace
+
+
+
+void ijson2::SidecarIndex::build(const char *json_filename, const char *index_filename, const std::vector<std::string> &key_paths) {
+	std::vector<std::vector<std::string>> split_paths;
+	for(const auto &key_path : key_paths)
+		split_paths.push_back(split_key_path(key_path));
+
+	FILE *fp = fopen(json_filename,"rb");
+	if(!fp)
+		throw std::system_error(errno,std::system_category(),json_filename);
+	Scanner scanner(split_paths);
+	uint64_t json_size, json_mtime;
+	try {
+		file_identity(fileno(fp),json_filename,&json_size,&json_mtime);
+		std::vector<char> buffer(scan_chunk_size);
+		size_t n;
+		while((n=fread(buffer.data(),1,buffer.size(),fp))>0)
+			scanner.feed(buffer.data(),n);
+		if(ferror(fp))
+			throw std::system_error(errno,std::system_category(),json_filename);
+		scanner.finish();
+	} catch(...) {
+		fclose(fp);
+		throw;
+	}
+	fclose(fp);
+
+	std::string buf(magic,sizeof(magic));
+	for(unsigned i=0; i<4; i++)
+		buf.push_back(static_cast<char>(format_version>>(i*8)));
+	for(unsigned i=0; i<4; i++)
+		buf.push_back(static_cast<char>(key_paths.size()>>(i*8)));
+	append_le64(&buf,json_size);
+	append_le64(&buf,json_mtime);
+	append_le64(&buf,scanner.records.size());
+	for(const auto &key_path : key_paths) {
+		append_le64(&buf,key_path.size());
+		buf += key_path;
+	}
+	for(const auto &r : scanner.records) {
+		append_le64(&buf,r.offset);
+		append_le64(&buf,r.length);
+	}
+	for(const auto &ranges : scanner.path_ranges) {
+		for(const auto &r : ranges) {
+			append_le64(&buf,r.offset);
+			append_le64(&buf,r.length);
+		}
+	}
+	for(auto &hashes : scanner.path_hashes) {
+		std::sort(hashes.begin(),hashes.end());
+		append_le64(&buf,hashes.size());
+		for(const auto &h : hashes) {
+			append_le64(&buf,h.first);
+			append_le64(&buf,h.second);
+		}
+	}
+
+	fp = fopen(index_filename,"wb");
+	if(!fp)
+		throw std::system_error(errno,std::system_category(),index_filename);
+	bool ok = fwrite(buf.data(),1,buf.size(),fp)==buf.size();
+	int e = errno;
+	if(fclose(fp)!=0 && ok) {
+		ok = false;
+		e = errno;
+	}
+	if(!ok)
+		throw std::system_error(e,std::system_category(),index_filename);
+}
+
+
+
+namespace {
+
+//Reads the index file contents sequentially with bounds checking
+class IndexReader {
+	const std::string &buf;
+	size_t pos;
+public:
+	IndexReader(const std::string &buf_, size_t pos_) : buf(buf_), pos(pos_) {}
+	void need(uint64_t bytes) {
+		if(bytes>buf.size()-pos)
+			throw sidecar_index_error("truncated index file");
+	}
+	void need_entries(uint64_t count) {
+		if(count>(buf.size()-pos)/16)
+			throw sidecar_index_error("truncated index file");
+	}
+	uint64_t le64() {
+		need(8);
+		uint64_t v = get_le64(buf.data()+pos);
+		pos += 8;
+		return v;
+	}
+	std::string bytes(uint64_t n) {
+		need(n);
+		std::string s(buf,pos,static_cast<size_t>(n));
+		pos += static_cast<size_t>(n);
+		return s;
+	}
+	bool at_end() const { return pos==buf.size(); }
+};
+
+} //anonymous namespace
+
+
+ijson2::SidecarIndex::SidecarIndex(const char *json_filename, const char *index_filename)
+  : fd(-1)
+{
+	std::string buf;
+	FILE *fp = fopen(index_filename,"rb");
+	if(!fp)
+		throw std::system_error(errno,std::system_category(),index_filename);
+	char chunk[65536];
+	size_t n;
+	while((n=fread(chunk,1,sizeof(chunk),fp))>0)
+		buf.append(chunk,n);
+	bool failed = ferror(fp);
+	int e = errno;
+	fclose(fp);
+	if(failed)
+		throw std::system_error(e,std::system_category(),index_filename);
+
+	if(buf.size()<header_size || memcmp(buf.data(),magic,sizeof(magic))!=0)
+		throw sidecar_index_error("not a sidecar index file");
+	uint64_t version_and_paths = get_le64(buf.data()+8);
+	if(static_cast<uint32_t>(version_and_paths)!=format_version)
+		throw sidecar_index_error("unsupported sidecar index version");
+	uint64_t path_count = version_and_paths>>32;
+	uint64_t indexed_size = get_le64(buf.data()+16);
+	uint64_t indexed_mtime = get_le64(buf.data()+24);
+	uint64_t record_count = get_le64(buf.data()+32);
+
+	IndexReader reader(buf,header_size);
+	//each record takes at least 16 bytes, so this also rejects absurd counts early
+	reader.need_entries(record_count);
+	for(uint64_t p=0; p<path_count; p++)
+		paths.push_back(reader.bytes(reader.le64()));
+	record_ranges.resize(static_cast<size_t>(record_count));
+	for(auto &r : record_ranges) {
+		r.offset = reader.le64();
+		r.length = reader.le64();
+	}
+	path_ranges.resize(paths.size());
+	for(auto &ranges : path_ranges) {
+		reader.need_entries(record_count);
+		ranges.resize(static_cast<size_t>(record_count));
+		for(auto &r : ranges) {
+			r.offset = reader.le64();
+			r.length = reader.le64();
+		}
+	}
+	path_hashes.resize(paths.size());
+	for(auto &hashes : path_hashes) {
+		uint64_t count = reader.le64();
+		reader.need_entries(count);
+		hashes.resize(static_cast<size_t>(count));
+		for(auto &h : hashes) {
+			h.first = reader.le64();
+			h.second = reader.le64();
+			if(h.second>=record_count)
+				throw sidecar_index_error("corrupt index file");
+		}
+	}
+	if(!reader.at_end())
+		throw sidecar_index_error("corrupt index file");
+
+	fd = open(json_filename,O_RDONLY);
+	if(fd<0)
+		throw std::system_error(errno,std::system_category(),json_filename);
+	try {
+		uint64_t json_size, json_mtime;
+		file_identity(fd,json_filename,&json_size,&json_mtime);
+		if(json_size!=indexed_size || json_mtime!=indexed_mtime)
+			throw sidecar_index_error("JSON file has changed since the index was built");
+		for(const auto &r : record_ranges)
+			if(r.offset>json_size || r.length>json_size-r.offset)
+				throw sidecar_index_error("corrupt index file");
+		for(const auto &ranges : path_ranges)
+			for(const auto &r : ranges)
+				if(r.offset>json_size || r.length>json_size-r.offset)
+					throw sidecar_index_error("corrupt index file");
+	} catch(...) {
+		close(fd);
+		throw;
+	}
+}
+
+
+ijson2::SidecarIndex::~SidecarIndex() {
+	close(fd);
+}
+
+
+size_t ijson2::SidecarIndex::path_number(const std::string &key_path) const {
+	for(size_t p=0; p<paths.size(); p++)
+		if(paths[p]==key_path)
+			return p;
+	throw std::out_of_range("key path not indexed: "+key_path);
+}
+
+
+void ijson2::SidecarIndex::read_range(const Range &r, std::string *text) const {
+	text->resize(static_cast<size_t>(r.length));
+	size_t done = 0;
+	while(done<text->size()) {
+		ssize_t n = pread(fd,&(*text)[done],text->size()-done,static_cast<off_t>(r.offset+done));
+		if(n<0) {
+			if(errno==EINTR)
+				continue;
+			throw std::system_error(errno,std::system_category(),"pread");
+		}
+		if(n==0)
+			throw sidecar_index_error("JSON file was truncated");
+		done += static_cast<size_t>(n);
+	}
+}
+
+
+void ijson2::SidecarIndex::read_record(size_t record, std::string *text) const {
+	read_range(record_ranges.at(record),text);
+}
+
+
+bool ijson2::SidecarIndex::read_value(size_t record, const std::string &key_path, std::string *text) const {
+	const Range &r = path_ranges[path_number(key_path)].at(record);
+	if(r.length==0)
+		return false;
+	read_range(r,text);
+	return true;
+}
+
+
+std::vector<size_t> ijson2::SidecarIndex::find(const std::string &key_path, const Value &key) const {
+	size_t p = path_number(key_path);
+	const auto &hashes = path_hashes[p];
+	uint64_t h = key.hash();
+	auto it = std::lower_bound(hashes.begin(),hashes.end(),std::make_pair(h,uint64_t(0)));
+	std::vector<size_t> found;
+	std::string text;
+	//verify the candidates in case of hash collisions
+	for(; it!=hashes.end() && it->first==h; ++it) {
+		size_t record = static_cast<size_t>(it->second);
+		read_range(path_ranges[p][record],&text);
+		Parser parser;
+		parser.parse(text.data(),text.size());
+		if(parser.value()==key)
+			found.push_back(record);
+	}
+	return found;
+}
@@ -0,0 +1,65 @@
+#ifndef IJSON2_SIDECAR_INDEX_HH_
+#define IJSON2_SIDECAR_INDEX_HH_
+#include "ijson2.hh"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//An on-disk index of a (huge) JSON file so single records can be looked up
+//without parsing the whole file.
+//
+//The records are the elements of the top-level array, or the top-level value
+//itself if it isn't an array. For each record the index holds the byte range of
+//the record and of the values at the chosen key paths. Key paths are member
+//names separated by slashes, eg. "/id" or "/user/name", relative to the record.
+//Member names are matched as they appear in the file, without unescaping.
+//Scalar values at key paths are also hashed so records can be found by value.
+
+namespace ijson2 {
+
+class SidecarIndex {
+public:
+	struct Range {
+		uint64_t offset;
+		uint64_t length; //0 if not present
+	};
+	
+	//Scan the JSON file and write the index file
+	static void build(const char *json_filename, const char *index_filename, const std::vector<std::string> &key_paths);
+	
+	//Open an index. Throws sidecar_index_error if the JSON file has changed since the index was built
+	SidecarIndex(const char *json_filename, const char *index_filename);
+	~SidecarIndex();
+	SidecarIndex(const SidecarIndex&) = delete;
+	SidecarIndex& operator=(const SidecarIndex&) = delete;
+	
+	size_t records() const { return record_ranges.size(); }
+	const std::vector<std::string> &key_paths() const { return paths; }
+	
+	//Read the JSON text of a record, ready for Parser::parse()
+	void read_record(size_t record, std::string *text) const;
+	//Read the JSON text of the value at an indexed key path in a record. Returns false if the record doesn't have it
+	bool read_value(size_t record, const std::string &key_path, std::string *text) const;
+	//The records where the value at the key path equals key
+	std::vector<size_t> find(const std::string &key_path, const Value &key) const;
+	
+private:
+	int fd;
+	std::vector<std::string> paths;
+	std::vector<Range> record_ranges;
+	std::vector<std::vector<Range>> path_ranges;                            //[path][record]
+	std::vector<std::vector<std::pair<uint64_t,uint64_t>>> path_hashes;    //[path] sorted (hash,record)
+	
+	size_t path_number(const std::string &key_path) const;
+	void read_range(const Range &r, std::string *text) const;
+};
+
+
+class sidecar_index_error : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+} //namespace
+
+#endif
@@ -0,0 +1,140 @@
+#include "ijson2_sidecar_index.hh"
+#include "ijson2_parser.hh"
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+using namespace ijson2;
+
+
+static std::string write_temp_file(const char *contents) {
+	char name[] = "/tmp/ijson2_sidecar_index_unittest_XXXXXX";
+	int fd = mkstemp(name);
+	assert(fd>=0);
+	size_t len = strlen(contents);
+	assert(write(fd,contents,len)==static_cast<ssize_t>(len));
+	close(fd);
+	return name;
+}
+
+
+int main(void) {
+	printf("Records in a top-level array\n");
+	{
+		static const char json[] =
+			"[\n"
+			" {\"id\":17, \"user\":{\"name\":\"Alice\",\"tags\":[1,2]}, \"text\":\"a ] tricky } \\\" string\"},\n"
+			" {\"id\":\"x17\", \"user\":{\"name\":\"Bob\"}},\n"
+			" {\"user\":{\"name\":\"Alice\"}, \"id\":17.0},\n"
+			" 42,\n"
+			" {\"id\":[1,2,3], \"user\":\"nobody\"}\n"
+			"]\n";
+		std::string json_file = write_temp_file(json);
+		std::string index_file = json_file+".idx";
+		SidecarIndex::build(json_file.c_str(),index_file.c_str(),{"/id","/user/name"});
+		
+		SidecarIndex index(json_file.c_str(),index_file.c_str());
+		assert(index.records()==5);
+		assert(index.key_paths().size()==2);
+		
+		std::string text;
+		index.read_record(3,&text);
+		assert(text=="42");
+		index.read_record(1,&text);
+		assert(text=="{\"id\":\"x17\", \"user\":{\"name\":\"Bob\"}}");
+		index.read_record(0,&text);
+		Parser parser;
+		parser.parse(text.data(),text.size());
+		assert(parser.value().object().at("text").string()=="a ] tricky } \" string");
+		
+		assert(index.read_value(0,"/user/name",&text) && text=="\"Alice\"");
+		assert(index.read_value(2,"/id",&text) && text=="17.0");
+		assert(index.read_value(4,"/id",&text) && text=="[1,2,3]");
+		assert(!index.read_value(3,"/id",&text));
+		assert(!index.read_value(4,"/user/name",&text));
+		
+		//numbers compare by value, so 17 also finds 17.0
+		auto found = index.find("/id",Value(17));
+		assert(found.size()==2 && found[0]==0 && found[1]==2);
+		found = index.find("/id",Value("x17"));
+		assert(found.size()==1 && found[0]==1);
+		found = index.find("/user/name",Value("Alice"));
+		assert(found.size()==2);
+		assert(index.find("/user/name",Value("Carol")).empty());
+		//containers at key paths are not hashed
+		assert(index.find("/id",Value(Value::array_type{Value(1),Value(2),Value(3)})).empty());
+		try {
+			index.find("/nosuchpath",Value(1));
+			assert(false);
+		} catch(const std::out_of_range &) {
+		}
+		
+		unlink(index_file.c_str());
+		unlink(json_file.c_str());
+	}
+	
+	printf("Single top-level value\n");
+	{
+		std::string json_file = write_temp_file("  {\"config\":{\"name\":\"main\"},\"n\":3}  ");
+		std::string index_file = json_file+".idx";
+		SidecarIndex::build(json_file.c_str(),index_file.c_str(),{"/config"});
+		SidecarIndex index(json_file.c_str(),index_file.c_str());
+		assert(index.records()==1);
+		std::string text;
+		assert(index.read_value(0,"/config",&text) && text=="{\"name\":\"main\"}");
+		index.read_record(0,&text);
+		assert(text=="{\"config\":{\"name\":\"main\"},\"n\":3}");
+		unlink(index_file.c_str());
+		unlink(json_file.c_str());
+	}
+	{
+		std::string json_file = write_temp_file("-12.5e3");
+		std::string index_file = json_file+".idx";
+		SidecarIndex::build(json_file.c_str(),index_file.c_str(),{});
+		SidecarIndex index(json_file.c_str(),index_file.c_str());
+		std::string text;
+		index.read_record(0,&text);
+		assert(text=="-12.5e3");
+		unlink(index_file.c_str());
+		unlink(json_file.c_str());
+	}
+	
+	printf("Errors\n");
+	for(const char *bad : {"[1,2", "[1,2}", "\"abc", "", "[1] 2"}) {
+		std::string json_file = write_temp_file(bad);
+		std::string index_file = json_file+".idx";
+		try {
+			SidecarIndex::build(json_file.c_str(),index_file.c_str(),{});
+			assert(false);
+		} catch(const sidecar_index_error &) {
+		}
+		unlink(json_file.c_str());
+	}
+	{
+		std::string json_file = write_temp_file("[1,2,3]");
+		std::string index_file = json_file+".idx";
+		SidecarIndex::build(json_file.c_str(),index_file.c_str(),{"/a"});
+		//the JSON file changes after the index was built
+		FILE *fp = fopen(json_file.c_str(),"a");
+		fputs("\n",fp);
+		fclose(fp);
+		try {
+			SidecarIndex index(json_file.c_str(),index_file.c_str());
+			assert(false);
+		} catch(const sidecar_index_error &) {
+		}
+		//not an index file
+		try {
+			SidecarIndex index(json_file.c_str(),json_file.c_str());
+			assert(false);
+		} catch(const sidecar_index_error &) {
+		}
+		unlink(index_file.c_str());
+		unlink(json_file.c_str());
+	}
+	
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include "ijson2_sink.hh"
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <system_error>
+
+
+void ijson2::FileOutput::write(const char *s, size_t l) {
+	if(fwrite(s,1,l,fp)!=l)
+		throw std::system_error(errno,std::system_category(),"fwrite");
+}
+
+
+void ijson2::FdOutput::write(const char *s, size_t l) {
+	while(l>0) {
+		ssize_t bytes = ::write(fd,s,l);
+		if(bytes<0) {
+			if(errno==EINTR)
+				continue;
+			throw std::system_error(errno,std::system_category(),"write");
+		}
+		s += bytes;
+		l -= static_cast<size_t>(bytes);
+	}
+}
+
+
+ijson2::BackgroundSink::BackgroundSink(append_fn_t append_pfn_, void *append_context_, unsigned buffer_count, size_t buffer_size_)
+  : append_pfn(append_pfn_),
+    append_context(append_context_),
+    buffer_size(buffer_size_<64 ? 64 : buffer_size_),
+    writing(false),
+    stopping(false),
+    current(nullptr),
+    used(0)
+{
+	if(buffer_count<2)
+		buffer_count = 2;
+	for(unsigned i=0; i<buffer_count; i++) {
+		buffers.emplace_back(new char[buffer_size]);
+		free_buffers.push_back(buffers.back().get());
+	}
+	current = free_buffers.back();
+	free_buffers.pop_back();
+	writer = std::thread(&BackgroundSink::writer_loop,this);
+}
+
+
+ijson2::BackgroundSink::~BackgroundSink() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	cv.notify_all();
+	writer.join();
+}
+
+
+void ijson2::BackgroundSink::writer_loop() {
+	std::unique_lock<std::mutex> lock(mtx);
+	for(;;) {
+		cv.wait(lock,[this]{ return !full_buffers.empty() || stopping; });
+		if(full_buffers.empty())
+			return; //stopping and everything queued has been written
+		std::pair<char*,size_t> b = full_buffers.front();
+		full_buffers.pop_front();
+		writing = true;
+		bool skip = static_cast<bool>(error);
+		lock.unlock();
+		std::exception_ptr e;
+		if(!skip) {
+			try {
+				append_pfn(b.first,b.second,append_context);
+			} catch(...) {
+				e = std::current_exception();
+			}
+		}
+		lock.lock();
+		if(e && !error)
+			error = e;
+		writing = false;
+		free_buffers.push_back(b.first);
+		cv.notify_all();
+	}
+}
+
+
+void ijson2::BackgroundSink::rethrow_error() {
+	//called with the mutex held. The error is kept, and the buffer is marked
+	//full so every later reserve() and append() comes here and throws again
+	if(error) {
+		used = buffer_size;
+		std::rethrow_exception(error);
+	}
+}
+
+
+//Queue the current buffer for writing and continue in a free one
+void ijson2::BackgroundSink::queue_current(std::unique_lock<std::mutex> &lock) {
+	if(used==0)
+		return;
+	full_buffers.emplace_back(current,used);
+	cv.notify_all();
+	cv.wait(lock,[this]{ return !free_buffers.empty(); });
+	current = free_buffers.back();
+	free_buffers.pop_back();
+	used = 0;
+}
+
+
+void ijson2::BackgroundSink::hand_over() {
+	std::unique_lock<std::mutex> lock(mtx);
+	rethrow_error();
+	queue_current(lock);
+	rethrow_error();
+}
+
+
+void ijson2::BackgroundSink::flush() {
+	std::unique_lock<std::mutex> lock(mtx);
+	rethrow_error();
+	queue_current(lock);
+	cv.wait(lock,[this]{ return full_buffers.empty() && !writing; });
+	rethrow_error();
+}
+
+
+void ijson2::IovecSink::new_chunk(size_t l) {
+	size_t size = l>chunk_size ? l : chunk_size;
+	chunks.emplace_back(new char[size]);
+	chunk_pos = chunks.back().get();
+	chunk_end = chunk_pos+size;
+}
+
+
+void ijson2::IovecSink::write_all(int fd) const {
+#ifdef IOV_MAX
+	static const size_t max_iovecs = IOV_MAX;
+#else
+	static const size_t max_iovecs = 1024;
+#endif
+	size_t i = 0;
+	iovec partial{nullptr,0};   //remainder of a partially written iovec
+	while(i<vecs.size() || partial.iov_len>0) {
+		ssize_t bytes;
+		if(partial.iov_len>0)
+			bytes = ::writev(fd,&partial,1);
+		else
+			bytes = ::writev(fd,vecs.data()+i,static_cast<int>(std::min(vecs.size()-i,max_iovecs)));
+		if(bytes<0) {
+			if(errno==EINTR)
+				continue;
+			throw std::system_error(errno,std::system_category(),"writev");
+		}
+		size_t written = static_cast<size_t>(bytes);
+		if(partial.iov_len>0) {
+			partial.iov_base = static_cast<char*>(partial.iov_base)+written;
+			partial.iov_len -= written;
+			continue;
+		}
+		while(i<vecs.size() && written>=vecs[i].iov_len) {
+			written -= vecs[i].iov_len;
+			i++;
+		}
+		if(written>0) {
+			partial.iov_base = static_cast<char*>(vecs[i].iov_base)+written;
+			partial.iov_len = vecs[i].iov_len-written;
+			i++;
+		}
+	}
+}
@@ -0,0 +1,521 @@
+#ifndef IJSON2_SINK_HH_
+#define IJSON2_SINK_HH_
+#include "ijson2_formatter.hh"
+#include "ijson2_formatting.hh"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/uio.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//Formatting into output sinks given as a template parameter, so the output is
+//written inline instead of through a callback.
+//
+//A sink is any class with these members:
+//  void append(const char *s, size_t l)  append l bytes
+//  char *reserve(size_t l)               room for writing up to l bytes directly. l is small (at most 64)
+//  void commit(size_t l)                 l bytes were written into the reserved room
+//  void flush()                          the output is complete
+//Sinks for strings, vectors and fixed buffers write directly into the
+//destination. The easiest way to make your own sink is BufferedSink<Output>
+//where Output has a write(const char *s, size_t l) member.
+
+namespace ijson2 {
+
+//Appends to a std::string. The string is grown in big steps and trimmed by flush()
+class StringSink {
+	std::string &str;
+	size_t used;
+	void grow(size_t l) {
+		size_t new_size = str.size()*2;
+		if(new_size<used+l)
+			new_size = used+l;
+		if(new_size<256)
+			new_size = 256;
+		str.resize(new_size);
+	}
+public:
+	explicit StringSink(std::string &str_) : str(str_), used(str_.size()) {}
+	char *reserve(size_t l) {
+		if(str.size()-used<l)
+			grow(l);
+		return &str[used];
+	}
+	void commit(size_t l) { used += l; }
+	void append(const char *s, size_t l) {
+		memcpy(reserve(l),s,l);
+		used += l;
+	}
+	void flush() { str.resize(used); }
+	size_t size() const { return used; }
+};
+
+
+//Appends to a std::vector<char>. The vector is grown in big steps and trimmed by flush()
+class VectorSink {
+	std::vector<char> &vec;
+	size_t used;
+	void grow(size_t l) {
+		size_t new_size = vec.size()*2;
+		if(new_size<used+l)
+			new_size = used+l;
+		if(new_size<256)
+			new_size = 256;
+		vec.resize(new_size);
+	}
+public:
+	explicit VectorSink(std::vector<char> &vec_) : vec(vec_), used(vec_.size()) {}
+	char *reserve(size_t l) {
+		if(vec.size()-used<l)
+			grow(l);
+		return vec.data()+used;
+	}
+	void commit(size_t l) { used += l; }
+	void append(const char *s, size_t l) {
+		memcpy(reserve(l),s,l);
+		used += l;
+	}
+	void flush() { vec.resize(used); }
+};
+
+
+//Writes into a fixed buffer. Throws insufficient_room if the output doesn't fit
+class BufferSink {
+	char *dst;
+	size_t dstsize;
+	size_t used;
+	char scratch[64];  //for reservations near the end of the buffer
+	bool in_scratch;
+public:
+	BufferSink(char *dst_, size_t dstsize_) : dst(dst_), dstsize(dstsize_), used(0), in_scratch(false) {}
+	char *reserve(size_t l) {
+		in_scratch = dstsize-used<l;
+		return in_scratch ? scratch : dst+used;
+	}
+	void commit(size_t l) {
+		if(in_scratch) {
+			in_scratch = false;
+			append(scratch,l);
+		} else
+			used += l;
+	}
+	void append(const char *s, size_t l) {
+		if(dstsize-used<l)
+			throw insufficient_room();
+		memcpy(dst+used,s,l);
+		used += l;
+	}
+	void flush() {}
+	size_t size() const { return used; }
+};
+
+
+//Collects the output in an intermediate buffer and hands it to Output::write() in big chunks
+template<class Output>
+class BufferedSink {
+	Output output;
+	char intermediate_buffer[16384];
+	size_t used;
+public:
+	explicit BufferedSink(const Output &output_) : output(output_), used(0) {}
+	BufferedSink(const BufferedSink&) = delete;
+	BufferedSink& operator=(const BufferedSink&) = delete;
+	char *reserve(size_t l) {
+		if(used+l>sizeof(intermediate_buffer))
+			flush();
+		return intermediate_buffer+used;
+	}
+	void commit(size_t l) { used += l; }
+	void append(const char *s, size_t l) {
+		if(used+l<=sizeof(intermediate_buffer)) {
+			memcpy(intermediate_buffer+used,s,l);
+			used += l;
+		} else {
+			flush();
+			if(l<sizeof(intermediate_buffer)) {
+				memcpy(intermediate_buffer,s,l);
+				used = l;
+			} else
+				output.write(s,l);
+		}
+	}
+	void flush() {
+		if(used>0)
+			output.write(intermediate_buffer,used);
+		used = 0;
+	}
+};
+
+
+struct CallbackOutput {
+	append_fn_t append_pfn;
+	void *append_context;
+	void write(const char *s, size_t l) { append_pfn(s,l,append_context); }
+};
+
+//The append_fn_t callback as a sink
+class CallbackSink : public BufferedSink<CallbackOutput> {
+public:
+	CallbackSink(append_fn_t append_pfn, void *append_context)
+	  : BufferedSink<CallbackOutput>(CallbackOutput{append_pfn,append_context})
+	  {}
+};
+
+
+struct FileOutput {
+	FILE *fp;
+	void write(const char *s, size_t l); //throws std::system_error
+};
+
+//Writes to a stdio stream
+class FileSink : public BufferedSink<FileOutput> {
+public:
+	explicit FileSink(FILE *fp) : BufferedSink<FileOutput>(FileOutput{fp}) {}
+};
+
+
+struct FdOutput {
+	int fd;
+	void write(const char *s, size_t l); //throws std::system_error
+};
+
+//Writes to a file descriptor
+class FdSink : public BufferedSink<FdOutput> {
+public:
+	explicit FdSink(int fd) : BufferedSink<FdOutput>(FdOutput{fd}) {}
+};
+
+
+
+//Hands full buffers to a writer thread which calls the callback, so formatting
+//continues into the next buffer while the previous one is being written. The
+//callback is called from the writer thread only, in order. flush() waits until
+//everything has been written and rethrows an exception thrown by the callback.
+//After such an exception the sink is unusable: the rest of the output is
+//discarded and every later append(), reserve() and flush() throws it again.
+//On destruction the buffers already handed to the writer thread are still
+//written, but the output in the current buffer, which only flush() or filling
+//it hands over, is discarded.
+class BackgroundSink {
+	append_fn_t append_pfn;
+	void *append_context;
+	size_t buffer_size;
+	std::vector<std::unique_ptr<char[]>> buffers;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<std::pair<char*,size_t>> full_buffers;  //waiting to be written, oldest first
+	std::vector<char*> free_buffers;
+	bool writing;
+	bool stopping;
+	std::exception_ptr error;
+	char *current;
+	size_t used;
+	std::thread writer;
+	void queue_current(std::unique_lock<std::mutex> &lock);
+	void hand_over();
+	void rethrow_error();
+	void writer_loop();
+public:
+	static const size_t default_buffer_size = 65536;
+	
+	//At least two buffers are used
+	BackgroundSink(append_fn_t append_pfn, void *append_context, unsigned buffer_count=2, size_t buffer_size=default_buffer_size);
+	~BackgroundSink();
+	BackgroundSink(const BackgroundSink&) = delete;
+	BackgroundSink& operator=(const BackgroundSink&) = delete;
+	
+	char *reserve(size_t l) {
+		if(buffer_size-used<l)
+			hand_over();
+		return current+used;
+	}
+	void commit(size_t l) { used += l; }
+	void append(const char *s, size_t l) {
+		while(buffer_size-used<l) {
+			size_t n = buffer_size-used;
+			memcpy(current+used,s,n);
+			used += n;
+			s += n;
+			l -= n;
+			hand_over();
+		}
+		memcpy(current+used,s,l);
+		used += l;
+	}
+	void flush();
+};
+
+
+//Collects the output as a list of iovecs for writev(). Long runs of string
+//characters which need no escaping are referred to in place, so the value tree
+//(and the parser input its strings may point into) must stay unchanged until
+//the output has been written. Everything else is copied into chunks owned by
+//the sink.
+class IovecSink {
+	std::vector<iovec> vecs;
+	std::vector<std::unique_ptr<char[]>> chunks;
+	char *chunk_pos;
+	char *chunk_end;
+	size_t reference_threshold;
+	size_t total;
+	void new_chunk(size_t l);
+	void add(const char *s, size_t l) {
+		if(!vecs.empty() && static_cast<const char*>(vecs.back().iov_base)+vecs.back().iov_len==s)
+			vecs.back().iov_len += l;
+		else
+			vecs.push_back(iovec{const_cast<char*>(s),l});
+		total += l;
+	}
+public:
+	static const size_t chunk_size = 16384;
+	
+	//Runs of at least reference_threshold bytes are referred to in place
+	explicit IovecSink(size_t reference_threshold_=64)
+	  : chunk_pos(nullptr),
+	    chunk_end(nullptr),
+	    reference_threshold(reference_threshold_),
+	    total(0)
+	  {}
+	
+	char *reserve(size_t l) {
+		if(static_cast<size_t>(chunk_end-chunk_pos)<l)
+			new_chunk(l);
+		return chunk_pos;
+	}
+	void commit(size_t l) {
+		if(l>0)
+			add(chunk_pos,l);
+		chunk_pos += l;
+	}
+	void append(const char *s, size_t l) {
+		memcpy(reserve(l),s,l);
+		commit(l);
+	}
+	//Refer to the bytes in place if the run is long enough
+	void append_unescaped(const char *s, size_t l) {
+		if(l>=reference_threshold)
+			add(s,l);
+		else
+			append(s,l);
+	}
+	void flush() {}
+	
+	const std::vector<iovec> &iovecs() const { return vecs; }
+	size_t size() const { return total; }
+	//Write everything with writev(), handling short writes. Throws std::system_error
+	void write_all(int fd) const;
+};
+
+inline void append_unescaped(IovecSink &sink, const char *s, size_t l) {
+	sink.append_unescaped(s,l);
+}
+
+
+
+namespace formatting {
+
+template<class Sink>
+void format_value(const Value &v, Sink &sink, int level, nonfinite_policy_t nonfinite_policy);
+
+template<class Sink>
+inline void append_indent(Sink &sink, int level) {
+	//yes, we use tabs.
+	while(level>0) {
+		static const char eight_tabs[8]={'\t','\t','\t','\t','\t','\t','\t','\t'};
+		int n = level<8 ? level : 8;
+		sink.append(eight_tabs, n);
+		level -= n;
+	}
+}
+
+template<class Sink>
+inline void append_string(const string_view &sv, Sink &sink) {
+	sink.append("\"",1);
+	append_escaped(sv,sink);
+	sink.append("\"",1);
+}
+
+//Longest member name append_member_name() copies in one go
+static const size_t max_short_member_name_length = 61;
+
+//Append the quoted member name and the colon. Short names which need no
+//escaping (nearly all of them) are checked while they are copied, and output
+//with a single reserve/commit. Otherwise the uncommitted copy is left behind
+//and overwritten by the escaped name, which is longer.
+template<class Sink>
+inline void append_member_name(const string_view &name, Sink &sink) {
+	size_t l = name.size();
+	if(l<=max_short_member_name_length) {
+		const char *s = name.data();
+		char *p = sink.reserve(l+3);
+		size_t i = 0;
+		while(i<l && escape_sequence[static_cast<uint8_t>(s[i])].length==0) {
+			p[i+1] = s[i];
+			i++;
+		}
+		if(i==l) {
+			p[0] = '"';
+			p[l+1] = '"';
+			p[l+2] = ':';
+			sink.commit(l+3);
+			return;
+		}
+	}
+	append_string(name,sink);
+	sink.append(":",1);
+}
+
+template<class Sink>
+inline void append_int64(int64_t i, Sink &sink) {
+	char *p = sink.reserve(max_integer_length+1);
+	sink.commit(format_int64(i,p)-p);
+}
+
+//NaN or infinity with nonfinite_policy_t::error. Sinks which report errors
+//without exceptions overload this.
+template<class Sink>
+inline void nonfinite_error(Sink &) {
+	throw nonfinite_number();
+}
+
+template<class Sink>
+void append_double(double d, Sink &sink, nonfinite_policy_t nonfinite_policy) {
+	//in many scenarios doubles are actually whole numbers
+	if(d>=-9223372036854775808.0 && d<9223372036854775808.0) {
+		int64_t i = static_cast<int64_t>(d);
+		if(d == i) {
+			append_int64(i,sink);
+			return;
+		}
+	}
+
+	switch(fpclassify(d)) {
+		case FP_NAN:
+		case FP_INFINITE: {
+			if(nonfinite_policy==nonfinite_policy_t::error) {
+				nonfinite_error(sink);
+				break;
+			}
+			char *p = sink.reserve(max_nonfinite_length);
+			sink.commit(format_nonfinite(d,nonfinite_policy,p)-p);
+			break;
+		}
+		case FP_ZERO:
+		case FP_SUBNORMAL:
+			sink.append("0",1);
+			break;
+		default: {
+			char *p = sink.reserve(max_double_length);
+			sink.commit(format_double(d,p)-p);
+			break;
+		}
+	}
+}
+
+template<class Sink>
+void format_array(const Value::array_type &a, Sink &sink, int level, nonfinite_policy_t nonfinite_policy) {
+	if(a.empty()) {
+		sink.append("[]",2);
+	} else {
+		sink.append("[",1);
+		bool first=true;
+		for(const auto &e : a) {
+			if(!first)
+				sink.append(",",1);
+			if(level>=0) sink.append("\n",1);
+			append_indent(sink,level>=0?level+1:level);
+			format_value(e,sink,level>=0?level+1:level,nonfinite_policy);
+			first = false;
+		}
+		if(level>=0) sink.append("\n",1);
+		append_indent(sink,level);
+		sink.append("]",1);
+	}
+}
+
+template<class Sink>
+void format_object(const Value::map_type &o, Sink &sink, int level, nonfinite_policy_t nonfinite_policy) {
+	if(o.empty()) {
+		sink.append("{}",2);
+	} else {
+		sink.append("{",1);
+		bool first=true;
+		for(const auto &e : o) {
+			if(!first)
+				sink.append(",",1);
+			if(level>=0) sink.append("\n",1);
+			append_indent(sink,level>=0?level+1:level);
+			append_member_name(e.first,sink);
+			format_value(e.second,sink,level>=0?level+1:level,nonfinite_policy);
+			first = false;
+		}
+		if(level>=0) sink.append("\n",1);
+		append_indent(sink,level);
+		sink.append("}",1);
+	}
+}
+
+template<class Sink>
+void format_value(const Value &v, Sink &sink, int level, nonfinite_policy_t nonfinite_policy) {
+	if(level<0) {
+		//cached text is output verbatim (and can be referred to in place like unescaped string contents)
+		if(const std::string *m = v.memoized_compact(nonfinite_policy)) {
+			append_unescaped(sink,m->data(),m->size());
+			return;
+		}
+	}
+	switch(v.value_type) {
+		case value_type_t::object:
+			format_object(v.object(),sink,level,nonfinite_policy);
+			break;
+		case value_type_t::array:
+			format_array(v.array(),sink,level,nonfinite_policy);
+			break;
+		case value_type_t::string:
+			append_string(v.string(),sink);
+			break;
+		case value_type_t::boolean:
+			if(v.u.bool_value)
+				sink.append("true",4);
+			else
+				sink.append("false",5);
+			break;
+		case value_type_t::number_double:
+			append_double(v.u.number_doublevalue,sink,nonfinite_policy);
+			break;
+		case value_type_t::number_int64:
+			append_int64(v.u.number_int64value,sink);
+			break;
+		case value_type_t::null:
+			sink.append("null",4);
+			break;
+		case value_type_t::raw_json: {
+			string_view json = v.raw_json();
+			append_unescaped(sink,json.data(),json.size());
+			break;
+		}
+	}
+}
+
+} //namespace formatting
+
+
+//Format the value into the sink and flush it
+template<class Sink>
+void format_to(Sink &sink, const Value &v, bool pretty=false, nonfinite_policy_t nonfinite_policy=nonfinite_policy_t::error) {
+	formatting::format_value(v,sink,pretty?0:-1,nonfinite_policy);
+	if(pretty) sink.append("\n",1);
+	sink.flush();
+}
+
+} //namespace ijson2
+
+#endif
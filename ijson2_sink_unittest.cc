@@ -0,0 +1,268 @@
+#include "ijson2_sink.hh"
+#include "ijson2_parser.hh"
+#include "ijson2_direct_formatter.hh"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ijson2;
+
+
+//a user-defined output for BufferedSink
+struct CountingOutput {
+	size_t *bytes;
+	size_t *writes;
+	void write(const char *, size_t l) { *bytes += l; (*writes)++; }
+};
+
+
+int main(void) {
+	static const char json[] = "{\"a\":[1,-2.5,\"x\\ty\",true,null],\"b\":{\"c\":1e300}}";
+	Parser parser;
+	parser.parse(json,sizeof(json)-1);
+	const Value &v = parser.value();
+	std::string expected;
+	format(v,[](const char *src, size_t srcsize, void *append_context) {
+		*reinterpret_cast<std::string*>(append_context) += std::string(src,srcsize);
+	},&expected);
+	assert(expected==json);
+	
+	printf("StringSink\n");
+	{
+		std::string s("prefix:");
+		StringSink sink(s);
+		format_to(sink,v);
+		assert(s=="prefix:"+expected);
+		
+		s.clear();
+		StringSink sink2(s);
+		format_to(sink2,v,true);
+		assert(s=="{\n\t\"a\":[\n\t\t1,\n\t\t-2.5,\n\t\t\"x\\ty\",\n\t\ttrue,\n\t\tnull\n\t],\n\t\"b\":{\n\t\t\"c\":1e300\n\t}\n}\n");
+	}
+	
+	printf("VectorSink\n");
+	{
+		std::vector<char> vec;
+		VectorSink sink(vec);
+		format_to(sink,v);
+		assert(std::string(vec.begin(),vec.end())==expected);
+	}
+	
+	printf("BufferSink\n");
+	{
+		//exactly the right size, with a number at the end of the buffer
+		static const char json2[] = "[\"abc\",0.125]";
+		Parser parser2;
+		parser2.parse(json2,sizeof(json2)-1);
+		char buf[sizeof(json2)-1];
+		BufferSink sink(buf,sizeof(buf));
+		format_to(sink,parser2.value());
+		assert(sink.size()==sizeof(buf));
+		assert(memcmp(buf,json2,sizeof(buf))==0);
+		
+		BufferSink sink2(buf,sizeof(buf)-1);
+		try {
+			format_to(sink2,parser2.value());
+			assert(false);
+		} catch(const insufficient_room &) {
+		}
+	}
+	
+	printf("FileSink\n");
+	{
+		FILE *fp = tmpfile();
+		assert(fp);
+		FileSink sink(fp);
+		format_to(sink,v);
+		rewind(fp);
+		char buf[256];
+		size_t n = fread(buf,1,sizeof(buf),fp);
+		assert(std::string(buf,n)==expected);
+		fclose(fp);
+	}
+	
+	printf("FdSink\n");
+	{
+		int fds[2];
+		assert(pipe(fds)==0);
+		FdSink sink(fds[1]);
+		format_to(sink,v);
+		close(fds[1]);
+		char buf[256];
+		ssize_t n = read(fds[0],buf,sizeof(buf));
+		assert(n>0 && std::string(buf,n)==expected);
+		close(fds[0]);
+	}
+	
+	printf("IovecSink\n");
+	{
+		std::string long_string(1000,'x');
+		static const char json2[] = "[\"short\",\"a string in the parser input which is long enough to be referenced in place\",\"escaped\\n string which is long enough to be referenced in place\",-2.5]";
+		Parser parser2;
+		parser2.parse(json2,sizeof(json2)-1);
+		Value v2(parser2.value());
+		v2.array().emplace_back(string_view(long_string.data(),long_string.size()));
+		std::string expected2 = format_to_string(v2);
+		
+		IovecSink sink;
+		format_to(sink,v2);
+		assert(sink.size()==expected2.size());
+		std::string collected;
+		bool referenced_input = false, referenced_long = false;
+		for(const auto &iov : sink.iovecs()) {
+			const char *base = static_cast<const char*>(iov.iov_base);
+			collected.append(base,iov.iov_len);
+			if(base>=json2 && base<json2+sizeof(json2))
+				referenced_input = true;
+			if(base==v2.array().back().string().data())
+				referenced_long = true;
+		}
+		assert(collected==expected2);
+		assert(referenced_input);
+		assert(referenced_long);
+		
+		int fds[2];
+		assert(pipe(fds)==0);
+		sink.write_all(fds[1]);
+		close(fds[1]);
+		std::string from_pipe;
+		char buf[4096];
+		ssize_t n;
+		while((n=read(fds[0],buf,sizeof(buf)))>0)
+			from_pipe.append(buf,n);
+		close(fds[0]);
+		assert(from_pipe==expected2);
+	}
+	
+	printf("BackgroundSink\n");
+	{
+		//a big value so many buffers are handed over
+		Value big{Value::array_type()};
+		for(int i=0; i<20000; i++)
+			big.array().push_back(v);
+		std::string expected_big = format_to_string(big);
+		struct Collector {
+			std::string s;
+			std::thread::id thread;
+			int calls = 0;
+		};
+		auto collect = [](const char *src, size_t srcsize, void *append_context) {
+			Collector *c = static_cast<Collector*>(append_context);
+			assert(c->thread!=std::this_thread::get_id());
+			c->s.append(src,srcsize);
+			c->calls++;
+		};
+		for(unsigned buffers : {2U,3U,8U}) {
+			Collector c;
+			c.thread = std::this_thread::get_id();
+			BackgroundSink sink(collect,&c,buffers,4096);
+			format_to(sink,big);
+			assert(c.s==expected_big);
+			assert(c.calls>=static_cast<int>(expected_big.size()/4096));
+		}
+		{
+			//the sink can be reused after flush(), and large appends are split
+			Collector c;
+			BackgroundSink sink(collect,&c,2,64);
+			std::string chunk(1000,'y');
+			sink.append(chunk.data(),chunk.size());
+			sink.flush();
+			assert(c.s==chunk);
+			sink.append("z",1);
+			sink.flush();
+			assert(c.s==chunk+"z");
+		}
+		{
+			//DirectFormatter, which formats straight into the sink's (here small) buffers
+			Collector c;
+			BackgroundSink sink(collect,&c,2,64);
+			DirectFormatter df(sink,true);
+			std::string s2;
+			DirectFormatter df2([](const char *src, size_t srcsize, void *append_context) {
+				static_cast<std::string*>(append_context)->append(src,srcsize);
+			},&s2,true);
+			for(DirectFormatter *f : {&df,&df2}) {
+				f->open_array();
+				for(int i=0; i<5000; i++) {
+					if(i>0) f->append_array_member_separator();
+					f->append_string("background");
+					f->append_array_member_separator();
+					f->append_number(static_cast<int64_t>(i)*1000003);
+					f->append_array_member_separator();
+					f->append_number(i+0.25);
+				}
+				f->close_array();
+				f->flush();
+			}
+			assert(c.s==s2);
+			assert(c.s.find("4999.25")!=std::string::npos);
+		}
+		{
+			//errors in the writer thread are rethrown
+			BackgroundSink sink([](const char *, size_t, void *) {
+				throw std::runtime_error("disk full");
+			},nullptr,2,64);
+			bool caught = false;
+			try {
+				format_to(sink,big);
+			} catch(const std::runtime_error &) {
+				caught = true;
+			}
+			assert(caught);
+		}
+		{
+			//the error is sticky, so no output is written after a gap
+			size_t calls = 0;
+			BackgroundSink sink([](const char *, size_t, void *context) {
+				if(++*static_cast<size_t*>(context)==1)
+					throw std::runtime_error("disk full");
+			},&calls,2,64);
+			sink.append("x",1);
+			bool caught = false;
+			try {
+				sink.flush();
+			} catch(const std::runtime_error &) {
+				caught = true;
+			}
+			assert(caught);
+			for(int i=0; i<3; i++) {
+				caught = false;
+				try {
+					if(i==0)
+						sink.append("y",1);
+					else if(i==1)
+						sink.reserve(1);
+					else
+						sink.flush();
+				} catch(const std::runtime_error &) {
+					caught = true;
+				}
+				assert(caught);
+			}
+			assert(calls==1);
+		}
+	}
+	
+	printf("User-defined output and large output\n");
+	{
+		Value big{Value::array_type()};
+		Value::array_type &a = big.array();
+		for(int i=0; i<10000; i++)
+			a.emplace_back("a string long enough to fill the intermediate buffer several times");
+		std::string s;
+		StringSink string_sink(s);
+		format_to(string_sink,big,true);
+		size_t bytes = 0, writes = 0;
+		BufferedSink<CountingOutput> sink(CountingOutput{&bytes,&writes});
+		format_to(sink,big,true);
+		assert(bytes==s.size());
+		assert(writes>1 && writes<bytes/8192);
+	}
+	
+	return 0;
+}
@@ -1,6 +1,10 @@
 #include "ijson2.hh"
 #include <assert.h>
 #include <stdio.h>
+#include <thread>
+#include <vector>
+#include <unordered_set>
+#include <string>
 
 using namespace ijson2;
 
@@ -152,5 +156,242 @@ int main(void) {
 		assert(v1.array().size()==2);
 		assert(v0.array().size()==0);
 	}
+	
+	printf("compact representation\n");
+	{
+		assert(sizeof(Value)==16);
+		static const char short_string[] = "abcdefghijklmn";
+		static const char long_string[] = "abcdefghijklmno";
+		Value v0(short_string);
+		assert(v0.string()==short_string);
+		assert(v0.string().data()!=short_string);
+		Value v1(long_string);
+		assert(v1.string()==long_string);
+		assert(v1.string().data()==long_string);
+		Value v2(v0);
+		assert(v2.string()==short_string);
+		v2 = v1;
+		assert(v2.string()==long_string);
+		v2 = "";
+		assert(v2.string().empty());
+	}
+	{
+		Value v0(Value::array_type{});
+		assert(v0.u.array_elements==nullptr);
+		assert(v0.array().empty());
+		Value v1(Value::array_type{17,"abc"});
+		Value v2;
+		v2 = v1;
+		v1.array()[0] = 42;
+		assert(v2.array()[0].int64value()==17);
+		assert(v2.array()[1].string()=="abc");
+	}
+	{
+		Value v0(Value::map_type{{"abc",Value::array_type{17,42}}});
+		v0 = v0.object().at("abc");
+		assert(v0.array().size()==2);
+		v0 = std::move(v0.array()[1]);
+		assert(v0.int64value()==42);
+	}
+	
+	printf("shared trees\n");
+	{
+		Value v0(Value::map_type{{"abc",Value::array_type{17,42}},{"xyz",Value::map_type{{"foo",117}}}});
+		assert(!v0.is_shared());
+		v0.share();
+		const Value &c0 = v0;
+		assert(c0.is_shared());
+		assert(c0.object().at("xyz").is_shared());
+		Value v1(v0);
+		const Value &c1 = v1;
+		assert(v1.u.object_members==v0.u.object_members);
+		//modifying the copy clones the path to the modification only
+		v1.object()["abc"].array()[0] = 18;
+		assert(v1.u.object_members!=v0.u.object_members);
+		assert(c1.object().at("xyz").u.object_members==c0.object().at("xyz").u.object_members);
+		assert(c0.object().at("abc").array()[0].int64value()==17);
+		assert(c1.object().at("abc").array()[0].int64value()==18);
+		assert(c1.object().at("abc").array()[1].int64value()==42);
+		assert(c1.object().at("xyz").object().at("foo").int64value()==117);
+	}
+	{
+		//a shared tree that is only referenced once is modified in place
+		Value v0(Value::array_type{17,42});
+		v0.share();
+		auto node = v0.u.array_elements;
+		v0.array().push_back(117);
+		assert(v0.u.array_elements==node);
+		assert(!v0.is_shared());
+		assert(v0.array().size()==3);
+	}
+	{
+		Value v0(Value::array_type{});
+		for(int i=0; i<100; i++)
+			v0.array().push_back(Value::map_type{{"abc",Value::array_type{i,"def"}}});
+		v0.share();
+		std::vector<std::thread> threads;
+		for(int t=0; t<4; t++) {
+			threads.emplace_back([&v0]() {
+				for(int i=0; i<1000; i++) {
+					Value v1(v0);
+					Value v2(static_cast<const Value&>(v1).array()[i%100]);
+					v1.array()[i%100].object()["abc"] = i;
+					assert(static_cast<const Value&>(v2).object().at("abc").array().size()==2);
+				}
+			});
+		}
+		for(auto &t : threads)
+			t.join();
+		assert(static_cast<const Value&>(v0).array()[17].object().at("abc").array()[0].int64value()==17);
+	}
+	
+	printf("equality and hashing\n");
+	{
+		assert(Value()==Value(nullptr));
+		assert(Value(true)!=Value(false));
+		assert(Value(true)!=Value(1));
+		assert(Value(17)==Value(17.0));
+		assert(Value(17.0)==Value(17));
+		assert(Value(17)!=Value(17.5));
+		assert(Value(17).hash()==Value(17.0).hash());
+		assert(Value(0).hash()==Value(-0.0).hash());
+		assert(Value(17).hash()!=Value(17.5).hash());
+		assert(Value("abc")==Value("abc"));
+		assert(Value("abc")!=Value("abd"));
+		assert(Value("abc").hash()!=Value("abd").hash());
+		assert(Value("a string that is stored out of line").hash()==Value(std::string("a string that is stored out of line").c_str()).hash());
+		assert(Value(Value::array_type{})==Value(Value::array_type{}));
+		assert(Value(Value::array_type{})!=Value(Value::map_type{}));
+		assert(Value(Value::array_type{1,2})!=Value(Value::array_type{2,1}));
+		assert(Value(Value::array_type{1,2}).hash()!=Value(Value::array_type{2,1}).hash());
+		assert(Value(Value::array_type{1,2}).hash()==Value(Value::array_type{1.0,2}).hash());
+		//a hash value must be stable
+		assert(Value(Value::map_type{{"abc",17}}).hash()==0x8bf0ba21c492fba2ULL);
+	}
+	{
+		Value v0(Value::map_type{});
+		v0.object()["abc"] = 17;
+		v0.object()["xyz"] = Value::array_type{true,nullptr};
+		Value v1(Value::map_type{});
+		v1.object()["xyz"] = Value::array_type{true,nullptr};
+		v1.object()["abc"] = 17.0;
+		assert(v0==v1);
+		assert(v0.hash()==v1.hash());
+		v1.object()["abc"] = 18;
+		assert(v0!=v1);
+		assert(v0.hash()!=v1.hash());
+		
+		std::unordered_set<Value> s;
+		s.insert(v0);
+		s.insert(v1);
+		s.insert(v0);
+		assert(s.size()==2);
+	}
+	{
+		//memoized hashes of shared trees are dropped when they are modified
+		Value v0(Value::map_type{{"abc",Value::array_type{17,42}}});
+		uint64_t h0 = v0.hash();
+		v0.share();
+		assert(v0.hash()==h0);
+		assert(v0.u.object_members->memoized_hash!=0);
+		Value v1(v0);
+		assert(v1==v0);
+		v1.object()["abc"].array().push_back(117);
+		assert(v1.hash()!=h0);
+		assert(v1!=v0);
+		assert(v0.hash()==h0);
+		v1.object()["abc"].array().pop_back();
+		assert(v1.hash()==h0);
+		assert(v1==v0);
+	}
+	
+	printf("raw JSON\n");
+	{
+		Value r0 = Value::from_raw_json("[1, 2]");
+		Value r1 = Value::from_raw_json("{\"a long raw value\":[1,2,3]}");
+		assert(r0.value_type==value_type_t::raw_json);
+		assert(r0.raw_json()=="[1, 2]");
+		assert(r1.raw_json()=="{\"a long raw value\":[1,2,3]}");
+		Value c(r1);
+		assert(c==r1 && c.hash()==r1.hash());
+		assert(r0!=r1);
+		//compared by text
+		assert(r0!=Value::from_raw_json("[1,2]"));
+		assert(r0!=Value("[1, 2]"));
+		assert(r0.hash()!=Value("[1, 2]").hash());
+		try {
+			r0.string();
+			assert(false);
+		} catch(const unexpected_value_type &) {
+		}
+	}
+	
+	printf("member lookup\n");
+	{
+		Value v0(Value::map_type{{"abc",17},{"def",42}});
+		assert(v0.find("abc")->int64value()==17);
+		assert(v0.at("def").int64value()==42);
+		assert(v0.find("xyz")==nullptr);
+		assert(v0.u.object_members->index==nullptr);
+		try {
+			v0.at("xyz");
+			assert(false);
+		} catch(const std::out_of_range &) {
+		}
+		assert(Value(Value::map_type{}).find("abc")==nullptr);
+		try {
+			Value(17).find("abc");
+			assert(false);
+		} catch(const unexpected_value_type &) {
+		}
+	}
+	{
+		std::vector<std::string> names;
+		for(int i=0; i<1000; i++)
+			names.push_back("member" + std::to_string(i));
+		Value v0(Value::map_type{});
+		for(int i=0; i<1000; i++)
+			v0.object()[names[i].c_str()] = i;
+		for(int i=0; i<1000; i++)
+			assert(v0.at(names[i].c_str()).int64value()==i);
+		assert(v0.find("member1000")==nullptr);
+		//unshared objects get no index, so changes through a reference held from earlier are seen
+		assert(v0.u.object_members->index==nullptr);
+		Value::map_type &members = v0.object();
+		const Value &c0 = v0;
+		members["member1000"] = 1000;
+		assert(c0.at("member1000").int64value()==1000);
+		members.erase("member0");
+		assert(c0.find("member0")==nullptr);
+		members.erase("member1000");
+		members["member0"] = 0;
+		assert(c0.find("member1000")==nullptr);
+		assert(c0.at("member0").int64value()==0);
+		assert(v0.u.object_members->index==nullptr);
+		
+		//shared objects are immutable and get an index
+		v0.share();
+		assert(c0.at("member999").int64value()==999);
+		assert(v0.u.object_members->index!=nullptr);
+		//modifying unshares the node and drops the index
+		v0.object()["member1000"] = 1000;
+		assert(v0.u.object_members->index==nullptr);
+		assert(!v0.is_shared());
+		assert(v0.at("member1000").int64value()==1000);
+		
+		//concurrent lookups in a shared tree
+		v0.share();
+		std::vector<std::thread> threads;
+		for(int t=0; t<4; t++) {
+			threads.emplace_back([&v0,&names]() {
+				Value v1(v0);
+				const Value &c1 = v1;
+				for(int i=0; i<1000; i++)
+					assert(c1.at(names[i].c_str()).int64value()==i);
+			});
+		}
+		for(auto &t : threads)
+			t.join();
+	}
 	return 0;
 }
@@ -5,6 +5,26 @@
 #include <sys/resource.h>
 
 
+static rusage ru_start;
+
+static void start_timing() {
+	getrusage(RUSAGE_SELF,&ru_start);
+}
+
+static void stop_timing(const char *what) {
+	rusage ru_end;
+	getrusage(RUSAGE_SELF,&ru_end);
+	
+	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
+	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
+	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
+	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
+	printf("%s:\n", what);
+	printf("  utime: %.3f\n", utime);
+	printf("  stime: %.3f\n", stime);
+}
+
+
 int main() {
 	FILE *fp = fopen("performance_test_input.json", "r");
 	if(!fp) {
@@ -19,24 +39,49 @@ int main() {
 	fread(buf, 1, bytes, fp);
 	fclose(fp);
 	
-	rusage ru_start;
-	getrusage(RUSAGE_SELF,&ru_start);
-	
+	start_timing();
 	for(int i=0; i<1000; i++) {
 		ijson2::Parser parser;
 		parser.parse(buf, bytes);
 	}
+	stop_timing("parse()");
 	
-	rusage ru_end;
-	getrusage(RUSAGE_SELF,&ru_end);
+	//a flood of bad requests: small inputs which are malformed in various places
+	static const char *const bad_inputs[] = {
+		"{\"id\":17,\"name\":\"foo\",\"tags\":[1,2,3,]}",
+		"{\"id\":17,\"name\":\"foo\" \"tags\":[1,2,3]}",
+		"{\"id\":017,\"name\":\"foo\",\"tags\":[1,2,3]}",
+		"{\"id\":17,\"name\":\"foo\\q\",\"tags\":[1,2,3]}",
+		"{\"id\":17,\"name\":\"foo\",\"tags\":[1,2,3]",
+		"{\"id\":17,\"name\":\"foo\",\"tags\":[1,2,3]} trailing",
+	};
+	static const size_t bad_input_count = sizeof(bad_inputs)/sizeof(bad_inputs[0]);
+	size_t bad_input_lengths[bad_input_count];
+	for(size_t j=0; j<bad_input_count; j++)
+		bad_input_lengths[j] = strlen(bad_inputs[j]);
+	
+	unsigned errors = 0;
+	start_timing();
+	for(int i=0; i<1000000; i++) {
+		ijson2::Parser parser;
+		try {
+			parser.parse(bad_inputs[i%bad_input_count], bad_input_lengths[i%bad_input_count]);
+		} catch(const ijson2::parser_error &) {
+			errors++;
+		}
+	}
+	stop_timing("invalid inputs, parse()");
+	
+	start_timing();
+	for(int i=0; i<1000000; i++) {
+		ijson2::Parser parser;
+		if(!parser.try_parse(bad_inputs[i%bad_input_count], bad_input_lengths[i%bad_input_count]))
+			errors++;
+	}
+	stop_timing("invalid inputs, try_parse()");
+	if(errors!=2000000)
+		printf("unexpected number of errors: %u\n", errors);
 	
-	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
-	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
-	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
-	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
-	printf("utime: %.3f\n", utime);
-	printf("stime: %.3f\n", stime);
-
 	delete[] buf;
 	
 	return 0;
@@ -0,0 +1,102 @@
+#include "ijson2_parser.hh"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+
+
+static rusage ru_start;
+
+static void start_timing() {
+	getrusage(RUSAGE_SELF,&ru_start);
+}
+
+static void stop_timing(const char *what) {
+	rusage ru_end;
+	getrusage(RUSAGE_SELF,&ru_end);
+	
+	double utime = ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec
+	             + (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec)/1000000.0;
+	double stime = ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec
+	             + (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec)/1000000.0;
+	printf("%s:\n", what);
+	printf("  utime: %.3f\n", utime);
+	printf("  stime: %.3f\n", stime);
+}
+
+
+int main() {
+	FILE *fp = fopen("performance_test_input.json", "r");
+	if(!fp) {
+		perror("performance_test_input.json");
+		return 1;
+	}
+	fseek(fp,0,SEEK_END);
+	long bytes = ftell(fp);
+	fseek(fp,0,SEEK_SET);
+	
+	char *buf = new char[bytes];
+	fread(buf, 1, bytes, fp);
+	fclose(fp);
+	
+	//std::vector<Value> growth moves the elements when the move constructor is noexcept
+	start_timing();
+	for(int i=0; i<100; i++) {
+		ijson2::Value::array_type a;
+		for(int j=0; j<10000; j++)
+			a.emplace_back(ijson2::Value::map_type{{"foo",ijson2::Value::array_type{17,42,117}},{"boo","a string which is not inline"}});
+	}
+	stop_timing("vector growth");
+	
+	//member lookup in a large object
+	{
+		std::vector<std::string> names;
+		for(int i=0; i<10000; i++)
+			names.push_back("id-" + std::to_string(i*7919));
+		ijson2::Value o(ijson2::Value::map_type{});
+		for(const auto &name : names)
+			o.object()[name.c_str()] = 17;
+		o.share(); //only shared objects get an index
+		const ijson2::Value &c = o;
+		int64_t sum = 0;
+		start_timing();
+		for(int i=0; i<100; i++)
+			for(const auto &name : names)
+				sum += c.object().at(name.c_str()).int64value();
+		stop_timing("lookup with std::map::at()");
+		start_timing();
+		for(int i=0; i<100; i++)
+			for(const auto &name : names)
+				sum += c.at(name.c_str()).int64value();
+		stop_timing("lookup with Value::at()");
+		if(sum!=2*100*17*10000)
+			printf("wrong sum\n");
+	}
+	
+	//keeping the result after the parser is gone
+	std::vector<ijson2::Value> copies;
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		ijson2::Parser parser;
+		parser.parse(buf, bytes);
+		copies.emplace_back(parser.value());
+	}
+	stop_timing("parse and copy");
+	copies.clear();
+	
+	std::vector<ijson2::Document> documents;
+	start_timing();
+	for(int i=0; i<1000; i++) {
+		ijson2::Parser parser;
+		parser.parse(buf, bytes);
+		documents.emplace_back(parser.release());
+	}
+	stop_timing("parse and release");
+	documents.clear();
+	
+	delete[] buf;
+	
+	return 0;
+}